@@ -0,0 +1,129 @@
+#include <QCoreApplication>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCommandLineOption>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QTextStream>
+
+#include "rpc-bench.h"
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("RPC Bench");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption transport_opt(
+                QStringList() << "t" << "transport",
+                QCoreApplication::translate("main", "Transport: xhr, ws or delimited [default: ws]"),
+                QCoreApplication::translate("main", "transport"), QStringLiteral("ws"));
+    parser.addOption(transport_opt);
+    QCommandLineOption host_opt(
+                QStringList() << "host",
+                QCoreApplication::translate("main", "Server Host [default: localhost]"),
+                QCoreApplication::translate("main", "host"), QStringLiteral("localhost"));
+    parser.addOption(host_opt);
+    QCommandLineOption port_opt(
+                QStringList() << "port",
+                QCoreApplication::translate("main", "Server Port [default: 8088 for xhr, 8089 otherwise]"),
+                QCoreApplication::translate("main", "port"), QStringLiteral("0"));
+    parser.addOption(port_opt);
+    QCommandLineOption rate_opt(
+                QStringList() << "r" << "rate",
+                QCoreApplication::translate("main", "Requests per second [default: 1000]"),
+                QCoreApplication::translate("main", "rate"), QStringLiteral("1000"));
+    parser.addOption(rate_opt);
+    QCommandLineOption duration_opt(
+                QStringList() << "d" << "duration",
+                QCoreApplication::translate("main", "Duration in seconds [default: 10]"),
+                QCoreApplication::translate("main", "duration"), QStringLiteral("10"));
+    parser.addOption(duration_opt);
+    QCommandLineOption connections_opt(
+                QStringList() << "c" << "connections",
+                QCoreApplication::translate("main", "WS Connections [default: 1]"),
+                QCoreApplication::translate("main", "connections"), QStringLiteral("1"));
+    parser.addOption(connections_opt);
+    QCommandLineOption methods_opt(
+                QStringList() << "m" << "methods",
+                QCoreApplication::translate("main", "Methods, or listen for a stream [default: ack,add,sub,mul,div]"),
+                QCoreApplication::translate("main", "methods"), QStringLiteral("ack,add,sub,mul,div"));
+    parser.addOption(methods_opt);
+    QCommandLineOption ack_size_opt(
+                QStringList() << "ack-size",
+                QCoreApplication::translate("main", "ACK Timestamp Size [default: 0 (ISO date)]"),
+                QCoreApplication::translate("main", "ack-size"), QStringLiteral("0"));
+    parser.addOption(ack_size_opt);
+    QCommandLineOption timeout_opt(
+                QStringList() << "timeout",
+                QCoreApplication::translate("main", "Drain Timeout in milli-seconds [default: 2000]"),
+                QCoreApplication::translate("main", "timeout"), QStringLiteral("2000"));
+    parser.addOption(timeout_opt);
+    QCommandLineOption json_opt(
+                QStringList() << "json",
+                QCoreApplication::translate("main", "JSON Report [default: false]"));
+    parser.addOption(json_opt);
+    QCommandLineOption replay_opt(
+                QStringList() << "replay",
+                QCoreApplication::translate("main", "Replay a capture of the server instead of generating requests [default: none]"),
+                QCoreApplication::translate("main", "replay"));
+    parser.addOption(replay_opt);
+    QCommandLineOption speed_opt(
+                QStringList() << "speed",
+                QCoreApplication::translate("main", "Replay Speed: a factor of the captured rate, or max [default: 1]"),
+                QCoreApplication::translate("main", "speed"), QStringLiteral("1"));
+    parser.addOption(speed_opt);
+    parser.process(app);
+
+    QString transport = parser.value(transport_opt);
+    Q_ASSERT(transport == "xhr" || transport == "ws" || transport == "delimited");
+    int port = parser.value(port_opt).toInt();
+    if (port == 0) {
+        port = transport == "xhr" ? 8088 : 8089;
+    }
+
+    QUrl url;
+    url.setScheme(transport == "xhr" ? "http" : "ws");
+    url.setHost(parser.value(host_opt));
+    url.setPort(port);
+    url.setPath("/");
+
+    RpcBench *bench = new RpcBench(
+                transport == "xhr" ? RpcBench::Xhr :
+                transport == "ws" ? RpcBench::Ws : RpcBench::Delimited, url);
+    bench->setRate(parser.value(rate_opt).toInt());
+    Q_ASSERT(bench->getRate() > 0);
+    bench->setDuration(parser.value(duration_opt).toInt());
+    Q_ASSERT(bench->getDuration() > 0);
+    bench->setConnections(parser.value(connections_opt).toInt());
+    Q_ASSERT(bench->getConnections() > 0);
+    bench->setMethods(parser.value(methods_opt).split(',', QString::SkipEmptyParts));
+    bench->setAckSize(parser.value(ack_size_opt).toInt());
+    bench->setTimeout(parser.value(timeout_opt).toInt());
+
+    if (parser.isSet(replay_opt)) {
+        double speed = parser.value(speed_opt) == QStringLiteral("max")
+                ? 0.0 : parser.value(speed_opt).toDouble();
+        Q_ASSERT(speed >= 0.0);
+        if (!bench->setReplay(parser.value(replay_opt), speed)) {
+            QTextStream(stderr) << parser.value(replay_opt) << ": no requests to replay\n";
+            return 1;
+        }
+    }
+
+    bool json = parser.isSet(json_opt);
+    QObject::connect(bench, &RpcBench::finished, [bench, json]() {
+        QTextStream out(stdout);
+        if (json) {
+            out << QJsonDocument(bench->report()).toJson(QJsonDocument::Compact) << "\n";
+        } else {
+            out << bench->table();
+        }
+        out.flush();
+        QCoreApplication::quit();
+    });
+
+    bench->start();
+    return app.exec();
+}
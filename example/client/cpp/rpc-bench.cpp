@@ -0,0 +1,506 @@
+#include "rpc-bench.h"
+#include "rpc-delimited.h"
+#include "rpc-capture.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QJsonArray>
+#include <QtCore/QTimer>
+#include <QtNetwork/QTcpSocket>
+#include <QtWebSockets/QWebSocket>
+
+#include "protocol/rpc.pb.h"
+#include "protocol/api.pb.h"
+
+RpcBench::RpcBench(Transport transport, QUrl url, QObject *parent)
+    : QObject(parent), m_transport(transport), m_url(url), m_elapsed(0),
+      m_sent(0), m_errors(0), m_stopped(false), m_stream(false), m_last(0),
+      m_replay_next(0), m_speed(1.0), m_connected(0),
+      m_rate(1000), m_duration(10), m_connections(1), m_ack_size(0), m_timeout(2000)
+{
+    m_timer = new QTimer(this);
+    Q_ASSERT(m_timer);
+    m_timer->setInterval(1);
+    m_timer->setTimerType(Qt::PreciseTimer);
+
+    QObject::connect(
+                m_timer, &QTimer::timeout, this, &RpcBench::onTick);
+
+    setMethods(QStringList() << "ack" << "add" << "sub" << "mul" << "div");
+}
+
+void RpcBench::setMethods(QStringList names) {
+    m_methods.clear();
+    foreach(QString name, names) {
+        RpcBenchMethod method;
+        method.name = name;
+        method.sent = method.received = 0;
+        if (name == "ack") {
+            method.fqn = ".Reflector.Service.ack";
+        } else if (name == "listen") {
+            method.fqn = ".Listener.Service.sub";
+        } else {
+            method.fqn = QString(".Calculator.Service.%1").arg(name).toStdString();
+        }
+        m_methods << method;
+    }
+    Q_ASSERT(!m_methods.isEmpty());
+
+    m_stream = names.contains("listen");
+    Q_ASSERT(!m_stream || names.length() == 1);
+}
+
+//
+// Replays the requests of a capture (see RpcCapture): They are sent at their
+// original offsets divided by `speed`, or as fast as possible for a speed of
+// zero. Each request gets a fresh id, since ids of different connections of
+// the capture may collide.
+//
+
+bool RpcBench::setReplay(QString path, double speed) {
+    RpcCaptureReader reader(path);
+    if (!reader.isValid()) {
+        return false;
+    }
+
+    QStringList names;
+    QVector<Replay> replay;
+    RpcCapture::Record record;
+    QByteArray bytes;
+    qint64 first = 0;
+    while (reader.next(&record, &bytes)) {
+        Rpc_Request rpc_req;
+        if (!rpc_req.ParseFromArray(bytes.constData(), bytes.length())) {
+            continue;
+        }
+
+        QString name = QString::fromStdString(rpc_req.name());
+        if (!names.contains(name)) {
+            names << name;
+        }
+        rpc_req.set_id(quint32(replay.size() + 1));
+        std::string data = rpc_req.SerializeAsString();
+
+        if (replay.isEmpty()) {
+            first = record.timestamp;
+        }
+        Replay request;
+        request.timestamp = record.timestamp - first;
+        request.method = names.indexOf(name);
+        request.bytes = QByteArray(data.data(), int(data.size()));
+        replay << request;
+    }
+    if (replay.isEmpty()) {
+        return false;
+    }
+
+    m_methods.clear();
+    foreach(QString name, names) {
+        RpcBenchMethod method;
+        method.name = name.section('.', -1);
+        method.fqn = name.toStdString();
+        method.sent = method.received = 0;
+        m_methods << method;
+    }
+
+    m_replay = replay;
+    m_replay_next = 0;
+    m_speed = speed;
+    m_stream = false;
+    return true;
+}
+
+void RpcBench::start() {
+    if (m_transport == Xhr) {
+        Q_ASSERT(!m_stream);
+        m_clock.start();
+        m_timer->start();
+        return;
+    }
+
+    QUrl url(m_url);
+    if (m_transport == Delimited) {
+        url.setQuery("encoding=delimited");
+    }
+    m_frames.resize(m_connections);
+    for (int i = 0; i < m_connections; i++) {
+        QWebSocket *socket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
+        Q_ASSERT(socket);
+
+        QObject::connect(
+                    socket, &QWebSocket::connected, this, &RpcBench::onWsConnected);
+        QObject::connect(
+                    socket, &QWebSocket::binaryMessageReceived, this, &RpcBench::onWsMessage);
+
+        m_sockets << socket;
+        socket->open(url);
+    }
+}
+
+void RpcBench::onWsConnected() {
+    m_connected += 1;
+    if (m_connected == m_sockets.length()) {
+        m_clock.start();
+        m_timer->start();
+
+        //
+        // Streams are subscribed to once per connection, upon which the
+        // server keeps pushing results: Their latencies are inter-arrival
+        // times of the results.
+        //
+
+        if (m_stream) {
+            for (; m_sent < quint64(m_sockets.length()); m_sent++) {
+                send(0, quint32(m_sent + 1), request(0, quint32(m_sent + 1)));
+            }
+            flush();
+        }
+    }
+}
+
+void RpcBench::onTick() {
+    m_elapsed = m_clock.nsecsElapsed();
+    bool done = m_replay.isEmpty()
+            ? m_elapsed >= qint64(m_duration) * 1000000000
+            : m_replay_next >= m_replay.size();
+    if (done) {
+        m_timer->stop();
+        m_stopped = true;
+        if (m_pending.isEmpty() || m_stream) {
+            onFinish();
+        } else {
+            QTimer::singleShot(m_timeout, this, &RpcBench::onFinish);
+        }
+        return;
+    }
+
+    if (m_stream) {
+        return;
+    }
+    if (!m_replay.isEmpty()) {
+        replay();
+        return;
+    }
+
+    quint64 due = quint64(double(m_elapsed) * m_rate / 1e9) + 1;
+    for (; m_sent < due; m_sent++) {
+        int method = int(m_sent % m_methods.size());
+        quint32 id = quint32(m_sent + 1);
+
+        Pending pending;
+        pending.intended = qint64(double(m_sent) * 1e9 / m_rate);
+        pending.method = method;
+        m_pending.insert(id, pending);
+
+        send(method, id, request(method, id));
+    }
+
+    flush();
+}
+
+void RpcBench::replay() {
+    for (int burst = 0; m_replay_next < m_replay.size(); burst++) {
+        const Replay &request = m_replay[m_replay_next];
+        qint64 intended = m_speed > 0
+                ? qint64(double(request.timestamp) / m_speed) : m_elapsed;
+        if (intended > m_elapsed || (m_speed <= 0 && burst >= 1024)) {
+            break;
+        }
+
+        quint32 id = quint32(m_replay_next + 1);
+        Pending pending;
+        pending.intended = intended;
+        pending.method = request.method;
+        m_pending.insert(id, pending);
+
+        m_sent += 1;
+        send(request.method, id, request.bytes);
+        m_replay_next += 1;
+    }
+
+    flush();
+}
+
+void RpcBench::flush() {
+    if (m_transport == Delimited) {
+        for (int i = 0; i < m_frames.size(); i++) {
+            if (!m_frames[i].isEmpty()) {
+                m_sockets[i]->sendBinaryMessage(RpcDelimited::Join(m_frames[i]));
+                m_frames[i].clear();
+            }
+        }
+    }
+}
+
+QByteArray RpcBench::request(int method, quint32 id) {
+    const QString &name = m_methods[method].name;
+    int lhs = qrand() % 2001 - 1000, rhs = qrand() % 1000 + 1;
+
+    std::string data;
+    if (name == "ack") {
+        QString timestamp = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+        Reflector::AckRequest req;
+        req.set_timestamp(m_ack_size > 0
+                          ? timestamp.leftJustified(m_ack_size, '0', true).toStdString()
+                          : timestamp.toStdString());
+        data = req.SerializeAsString();
+    } else if (name == "listen") {
+        Listener::SubRequest req;
+        req.set_timestamp(QDateTime::currentDateTimeUtc().toString(Qt::ISODate).toStdString());
+        data = req.SerializeAsString();
+    } else if (name == "add") {
+        Calculator::AddRequest req;
+        req.set_lhs(lhs);
+        req.set_rhs(rhs);
+        data = req.SerializeAsString();
+    } else if (name == "sub") {
+        Calculator::SubRequest req;
+        req.set_lhs(lhs);
+        req.set_rhs(rhs);
+        data = req.SerializeAsString();
+    } else if (name == "mul") {
+        Calculator::MulRequest req;
+        req.set_lhs(lhs);
+        req.set_rhs(rhs);
+        data = req.SerializeAsString();
+    } else if (name == "div") {
+        Calculator::DivRequest req;
+        req.set_lhs(lhs);
+        req.set_rhs(rhs);
+        data = req.SerializeAsString();
+    }
+
+    Rpc_Request rpc_req;
+    rpc_req.set_name(m_methods[method].fqn);
+    rpc_req.set_id(id);
+    rpc_req.set_data(data);
+
+    std::string bytes = rpc_req.SerializeAsString();
+    return QByteArray(bytes.data(), int(bytes.size()));
+}
+
+void RpcBench::send(int method, quint32 id, QByteArray bytes) {
+    m_methods[method].sent += 1;
+
+    switch (m_transport) {
+    case Xhr:
+        sendXhr(id, bytes);
+        break;
+    case Ws:
+        m_sockets[id % m_sockets.length()]->sendBinaryMessage(bytes);
+        break;
+    case Delimited:
+        m_frames[id % m_frames.size()] << bytes;
+        break;
+    }
+}
+
+void RpcBench::sendXhr(quint32 id, QByteArray bytes) {
+    QTcpSocket *socket = new QTcpSocket(this);
+    Q_ASSERT(socket);
+
+    //
+    // The request line is followed by exactly five headers, since that's
+    // the layout `RpcHttp::GetBody` of the QT/C++ server expects:
+    //
+
+    QByteArray http = "POST ";
+    http.append(m_url.path().isEmpty() ? "/" : m_url.path().toLatin1())
+            .append(" HTTP/1.1");
+    http.append("\r\n")
+            .append("Host: ")
+            .append(m_url.host().toLatin1());
+    http.append("\r\n")
+            .append("Accept: ")
+            .append("*/*");
+    http.append("\r\n")
+            .append("Connection: ")
+            .append("close");
+    http.append("\r\n")
+            .append("Content-Type: ")
+            .append("application/octet-stream");
+    http.append("\r\n")
+            .append("Content-Length: ")
+            .append(QByteArray::number(bytes.length()));
+    http.append("\r\n")
+            .append("\r\n")
+            .append(bytes);
+
+    QByteArray *buffer = new QByteArray();
+    QObject::connect(
+                socket, &QTcpSocket::connected, this, [socket, http]() {
+        socket->write(http);
+    });
+    QObject::connect(
+                socket, &QTcpSocket::readyRead, this, [socket, buffer]() {
+        buffer->append(socket->readAll());
+    });
+    QObject::connect(
+                socket, &QTcpSocket::disconnected, this, [this, id, socket, buffer]() {
+        buffer->append(socket->readAll());
+        int end = buffer->indexOf("\r\n\r\n");
+        if (buffer->startsWith("HTTP/1.1 200") && end > 0) {
+            QByteArray headers = buffer->left(end).toLower();
+            QByteArray body = buffer->mid(end + 4), data;
+            if (headers.contains("transfer-encoding: chunked")) {
+                int offset = 0;
+                while (true) {
+                    int eol = body.indexOf("\r\n", offset);
+                    int size = eol < 0 ? 0 : body.mid(offset, eol - offset).toInt(NULL, 16);
+                    if (size == 0) {
+                        break;
+                    }
+                    data.append(body.mid(eol + 2, size));
+                    offset = eol + 2 + size + 2;
+                }
+            } else {
+                data = body;
+            }
+            // servers send binary bodies as UTF-8 encoded latin-1 text:
+            complete(QString::fromUtf8(data).toLatin1());
+        } else {
+            fail(id);
+        }
+        delete buffer;
+        socket->deleteLater();
+    });
+    QObject::connect(
+                socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error),
+                this, [this, id, socket, buffer](QAbstractSocket::SocketError error) {
+        if (error == QAbstractSocket::ConnectionRefusedError ||
+            error == QAbstractSocket::HostNotFoundError) {
+            fail(id);
+            delete buffer;
+            socket->deleteLater();
+        }
+    });
+
+    socket->connectToHost(m_url.host(), m_url.port());
+}
+
+void RpcBench::onWsMessage(QByteArray bytes) {
+    if (m_transport == Delimited) {
+        foreach(QByteArray message, RpcDelimited::Split(bytes)) {
+            complete(message);
+        }
+    } else {
+        complete(bytes);
+    }
+}
+
+void RpcBench::complete(QByteArray bytes) {
+    qint64 now = m_clock.nsecsElapsed();
+
+    Rpc_Response rpc_res;
+    if (!rpc_res.ParseFromArray(bytes.constData(), bytes.length())) {
+        m_errors += 1;
+        return;
+    }
+    if (m_stream) {
+        if (!m_stopped) {
+            RpcBenchMethod &method = m_methods[0];
+            method.received += 1;
+            if (m_last > 0) {
+                method.latency.record(quint64(now - m_last) / 1000);
+            }
+            m_last = now;
+        }
+        return;
+    }
+    if (!m_pending.contains(rpc_res.id())) {
+        return;
+    }
+
+    Pending pending = m_pending.take(rpc_res.id());
+    RpcBenchMethod &method = m_methods[pending.method];
+    method.received += 1;
+    method.latency.record(quint64(qMax(now - pending.intended, qint64(0)) / 1000));
+
+    if (m_stopped && m_pending.isEmpty()) {
+        onFinish();
+    }
+}
+
+void RpcBench::fail(quint32 id) {
+    m_pending.remove(id);
+    m_errors += 1;
+
+    if (m_stopped && m_pending.isEmpty()) {
+        onFinish();
+    }
+}
+
+void RpcBench::onFinish() {
+    if (!m_stopped) {
+        return;
+    }
+    m_stopped = false;
+
+    foreach(QWebSocket *socket, m_sockets) {
+        socket->close();
+    }
+    emit finished();
+}
+
+QJsonObject RpcBench::report() const {
+    QJsonObject methods;
+    RpcHistogram total;
+    foreach(const RpcBenchMethod &method, m_methods) {
+        QJsonObject json;
+        json["sent"] = double(method.sent);
+        json["received"] = double(method.received);
+        json["rps"] = m_elapsed > 0 ? method.received * 1e9 / m_elapsed : 0.0;
+        json["p50"] = double(method.latency.percentile(50.0));
+        json["p99"] = double(method.latency.percentile(99.0));
+        json["p999"] = double(method.latency.percentile(99.9));
+        json["max"] = double(method.latency.max());
+        json["mean"] = method.latency.mean();
+        methods[method.name] = json;
+        total.add(method.latency);
+    }
+
+    QJsonObject json;
+    json["transport"] = m_transport == Xhr ? "xhr" : m_transport == Ws ? "ws" : "delimited";
+    json["url"] = m_url.toString();
+    json["rate"] = m_rate;
+    json["duration"] = m_duration;
+    json["connections"] = m_connections;
+    json["sent"] = double(m_sent);
+    json["received"] = double(total.count());
+    json["errors"] = double(m_errors);
+    json["timeouts"] = double(m_pending.size());
+    json["rps"] = m_elapsed > 0 ? total.count() * 1e9 / m_elapsed : 0.0;
+    json["p50"] = double(total.percentile(50.0));
+    json["p99"] = double(total.percentile(99.0));
+    json["p999"] = double(total.percentile(99.9));
+    json["max"] = double(total.max());
+    json["methods"] = methods;
+    return json;
+}
+
+QString RpcBench::table() const {
+    QJsonObject json = report();
+
+    QString text = QString("%1 %2 @ %3/s for %4s [connections: %5]\n")
+            .arg(json["transport"].toString(), m_url.toString())
+            .arg(m_rate).arg(m_duration).arg(m_connections);
+    text.append(QString("%1%2%3%4%5%6%7\n")
+                .arg("method", -8).arg("received", 10).arg("rps", 10)
+                .arg("p50[us]", 10).arg("p99[us]", 10).arg("p99.9[us]", 10).arg("max[us]", 10));
+
+    QJsonObject methods = json["methods"].toObject();
+    foreach(const RpcBenchMethod &method, m_methods) {
+        QJsonObject m = methods[method.name].toObject();
+        text.append(QString("%1%2%3%4%5%6%7\n")
+                    .arg(method.name, -8)
+                    .arg(qint64(m["received"].toDouble()), 10)
+                    .arg(m["rps"].toDouble(), 10, 'f', 1)
+                    .arg(qint64(m["p50"].toDouble()), 10)
+                    .arg(qint64(m["p99"].toDouble()), 10)
+                    .arg(qint64(m["p999"].toDouble()), 10)
+                    .arg(qint64(m["max"].toDouble()), 10));
+    }
+    text.append(QString("errors: %1, timeouts: %2\n")
+                .arg(qint64(json["errors"].toDouble()))
+                .arg(qint64(json["timeouts"].toDouble())));
+    return text;
+}
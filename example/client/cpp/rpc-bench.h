@@ -0,0 +1,121 @@
+#ifndef RPC_BENCH_H
+#define RPC_BENCH_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QJsonObject>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+#include <QtCore/QUrl>
+#include <QtCore/QVector>
+
+#include <string>
+
+#include "rpc-histogram.h"
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+QT_FORWARD_DECLARE_CLASS(QWebSocket)
+
+struct RpcBenchMethod
+{
+    QString name;
+    std::string fqn;
+    quint64 sent;
+    quint64 received;
+    RpcHistogram latency;
+};
+
+//
+// Open loop load generator: Requests are issued at a fixed rate regardless
+// of outstanding responses, and each latency is measured from the *intended*
+// send time of its request, such that stalls of the server (or the client)
+// are not hidden by coordinated omission.
+//
+
+class RpcBench : public QObject
+{
+    Q_OBJECT
+public:
+    enum Transport { Xhr, Ws, Delimited };
+    explicit RpcBench(Transport transport, QUrl url, QObject *parent = 0);
+
+Q_SIGNALS:
+    void finished();
+
+public:
+    void start();
+    QJsonObject report() const;
+    QString table() const;
+
+private Q_SLOTS:
+    void onTick();
+    void onWsConnected();
+    void onWsMessage(QByteArray bytes);
+    void onFinish();
+
+private:
+    void replay();
+    QByteArray request(int method, quint32 id);
+    void send(int method, quint32 id, QByteArray bytes);
+    void sendXhr(quint32 id, QByteArray bytes);
+    void flush();
+    void complete(QByteArray bytes);
+    void fail(quint32 id);
+
+private:
+    Transport m_transport;
+    QUrl m_url;
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_elapsed;
+    quint64 m_sent;
+    quint64 m_errors;
+    bool m_stopped;
+    bool m_stream;
+    qint64 m_last;
+
+private:
+    struct Replay {
+        qint64 timestamp;
+        int method;
+        QByteArray bytes;
+    };
+    QVector<Replay> m_replay;
+    int m_replay_next;
+    double m_speed;
+
+private:
+    struct Pending {
+        qint64 intended;
+        int method;
+    };
+    QHash<quint32, Pending> m_pending;
+    QVector<RpcBenchMethod> m_methods;
+    QList<QWebSocket*> m_sockets;
+    QVector<QList<QByteArray> > m_frames;
+    int m_connected;
+
+private:
+    int m_rate;
+    int m_duration;
+    int m_connections;
+    int m_ack_size;
+    int m_timeout;
+public:
+    int getRate() { return m_rate; }
+    void setRate(int value) { m_rate = value; }
+    int getDuration() { return m_duration; }
+    void setDuration(int value) { m_duration = value; }
+    int getConnections() { return m_connections; }
+    void setConnections(int value) { m_connections = value; }
+    int getAckSize() { return m_ack_size; }
+    void setAckSize(int value) { m_ack_size = value; }
+    int getTimeout() { return m_timeout; }
+    void setTimeout(int value) { m_timeout = value; }
+    void setMethods(QStringList names);
+    bool setReplay(QString path, double speed);
+};
+
+#endif // RPC_BENCH_H
@@ -0,0 +1,39 @@
+#-------------------------------------------------
+#
+# Open loop load generator for the RPC servers
+#
+#-------------------------------------------------
+
+QT       += core network websockets
+QT       -= gui
+
+TARGET = rpc-bench
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    protocol/api.pb.cc \
+    protocol/calculator.pb.cc \
+    protocol/listener.pb.cc \
+    protocol/reflector.pb.cc \
+    protocol/rpc.pb.cc \
+    rpc-bench.cpp \
+    ../../server/cpp/rpc-delimited.cpp \
+    ../../server/cpp/rpc-histogram.cpp \
+    ../../server/cpp/rpc-capture.cpp
+
+HEADERS += \
+    protocol/api.pb.h \
+    protocol/calculator.pb.h \
+    protocol/listener.pb.h \
+    protocol/reflector.pb.h \
+    protocol/rpc.pb.h \
+    rpc-bench.h \
+    ../../server/cpp/rpc-delimited.h \
+    ../../server/cpp/rpc-histogram.h \
+    ../../server/cpp/rpc-capture.h
+
+INCLUDEPATH += /usr/include $$PWD/../../server/cpp
+LIBS += -L/usr/lib/ -lprotobuf -pthread  -lpthread
@@ -0,0 +1,206 @@
+#!/usr/bin/env node
+///////////////////////////////////////////////////////////////////////////////
+
+let ArgumentParser = require('argparse').ArgumentParser;
+
+let assert = require('assert'),
+    child_process = require('child_process'),
+    fs = require('fs'),
+    path = require('path');
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+let parser = new ArgumentParser({
+    addHelp: true, description: 'RPC Comparison', version: '1.0.0'
+});
+parser.addArgument(['--servers'], {
+    help: 'Servers [default: cpp,js,py]', defaultValue: 'cpp,js,py',
+    nargs: '?'
+});
+parser.addArgument(['--transport'], {
+    help: 'Transport: ws or xhr [default: ws]', defaultValue: 'ws',
+    nargs: '?'
+});
+parser.addArgument(['--rate'], {
+    help: 'Requests per second [default: 1000]', defaultValue: 1000,
+    nargs: '?'
+});
+parser.addArgument(['--duration'], {
+    help: 'Seconds per workload [default: 10]', defaultValue: 10,
+    nargs: '?'
+});
+parser.addArgument(['--connections'], {
+    help: 'WS connections [default: 1]', defaultValue: 1,
+    nargs: '?'
+});
+parser.addArgument(['--ack-sizes'], {
+    help: 'ACK payload sizes [default: 32,1024,16384]',
+    defaultValue: '32,1024,16384', nargs: '?'
+});
+parser.addArgument(['--port'], {
+    help: 'First port to use [default: 38088]', defaultValue: 38088,
+    nargs: '?'
+});
+parser.addArgument(['--json'], {
+    help: 'JSON report file [default: none]', defaultValue: null,
+    nargs: '?'
+});
+
+///////////////////////////////////////////////////////////////////////////////
+
+let args = parser.parseArgs();
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+let root = path.join(__dirname, '../../..');
+let bench = path.join(root, 'example/client/cpp/build/rpc-bench');
+assert.ok(fs.existsSync(bench), `${bench}: not built`);
+
+let servers = {
+    cpp: {
+        command: path.join(root, 'example/server/cpp/build/rpc-server'),
+        args: (xhr, ws) => [`--xhr-port=${xhr}`, `--ws-port=${ws}`],
+        streams: false
+    },
+    js: {
+        command: 'node',
+        args: (xhr, ws) => [
+            path.join(root, 'example/server/js/rpc-server.js'),
+            `--xhr-port=${xhr}`, `--ws-port=${ws}`
+        ],
+        streams: true
+    },
+    py: {
+        command: path.join(root, 'example/server/py/env/bin/python'),
+        args: (xhr, ws) => [
+            path.join(root, 'example/server/py/rpc-server.py'),
+            `--xhr-port=${xhr}`, `--ws-port=${ws}`
+        ],
+        streams: false
+    }
+};
+
+let workloads = [{
+    name: 'calculator', methods: 'add,sub,mul,div', ack_size: 0
+}].concat(args.ack_sizes.split(',').map((size) => ({
+    name: `ack:${size}`, methods: 'ack', ack_size: parseInt(size)
+}))).concat([{
+    name: 'stream', methods: 'listen', ack_size: 0, stream: true
+}]);
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+function rss(pid) {
+    try {
+        let status = fs.readFileSync(`/proc/${pid}/status`, 'utf8');
+        let match = status.match(/^VmRSS:\s+(\d+)\s+kB$/m);
+        return match ? parseInt(match[1]) : 0;
+    } catch (ex) {
+        return 0;
+    }
+}
+
+function run(server, port, workload) {
+    return new Promise((resolve) => {
+        let bench_args = [
+            `--transport=${workload.stream ? 'ws' : args.transport}`,
+            `--port=${args.transport === 'xhr' && !workload.stream
+                ? port : port + 1}`,
+            `--rate=${args.rate}`, `--duration=${args.duration}`,
+            `--connections=${args.connections}`,
+            `--methods=${workload.methods}`,
+            `--ack-size=${workload.ack_size}`, '--json'
+        ];
+
+        let peak = rss(server.pid), sampler = setInterval(() => {
+            peak = Math.max(peak, rss(server.pid));
+        }, 100);
+
+        child_process.execFile(bench, bench_args, {
+            maxBuffer: 16 * 1024 * 1024
+        }, (error, stdout) => {
+            clearInterval(sampler);
+            let report = null;
+            if (!error) try {
+                report = JSON.parse(stdout);
+                report.rss = peak;
+            } catch (ex) {
+                report = null;
+            }
+            resolve(report);
+        });
+    });
+}
+
+async function compare(name, index) {
+    let server = servers[name];
+    assert.ok(server, `${name}: unknown server`);
+
+    let port = parseInt(args.port) + 2 * index,
+        results = {};
+    if (!fs.existsSync(server.command) && server.command !== 'node') {
+        console.error(`[${name}] ${server.command}: not built`);
+        return results;
+    }
+
+    let child = child_process.spawn(
+        server.command, server.args(port, port + 1), {stdio: 'ignore'});
+    await new Promise((resolve) => setTimeout(resolve, 1000));
+
+    for (let workload of workloads) {
+        if (workload.stream && !server.streams) {
+            results[workload.name] = null;
+            continue;
+        }
+        console.error(`[${name}] ${workload.name} ...`);
+        results[workload.name] = await run(child, port, workload);
+    }
+
+    child.kill();
+    return results;
+}
+
+function table(results) {
+    let names = Object.keys(results),
+        lines = [];
+
+    let cell = (text, width) => String(text).padStart(width);
+    lines.push('workload'.padEnd(14) + names.map((name) =>
+        cell(`${name}:rps`, 10) + cell('p50', 8) + cell('p99', 8) +
+        cell('rss[kB]', 10)).join(''));
+
+    for (let workload of workloads) {
+        lines.push(workload.name.padEnd(14) + names.map((name) => {
+            let report = results[name][workload.name];
+            if (!report) {
+                return cell('n/a', 10) + cell('-', 8) + cell('-', 8) +
+                    cell('-', 10);
+            }
+            return cell(report.rps.toFixed(1), 10) +
+                cell(report.p50, 8) + cell(report.p99, 8) +
+                cell(report.rss, 10);
+        }).join(''));
+    }
+    return lines.join('\n');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+(async function () {
+    let results = {},
+        names = args.servers.split(',');
+    for (let i = 0; i < names.length; i++) {
+        results[names[i]] = await compare(names[i], i);
+    }
+    if (args.json) {
+        fs.writeFileSync(args.json, JSON.stringify(results, null, 2));
+    }
+    console.log(table(results));
+})();
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,166 @@
+#include <benchmark/benchmark.h>
+
+#include <QtCore/QByteArray>
+
+#include "rpc-task.h"
+#include "rpc-http.h"
+#include "rpc-vector.h"
+
+#include <random>
+#include <vector>
+
+#include "protocol/rpc.pb.h"
+#include "protocol/api.pb.h"
+
+static QByteArray Envelope(const char *name, const std::string &data) {
+    Rpc_Request rpc_req;
+    rpc_req.set_name(name);
+    rpc_req.set_id(0x01020304);
+    rpc_req.set_data(data);
+
+    std::string bytes = rpc_req.SerializeAsString();
+    return QByteArray(bytes.data(), int(bytes.size()));
+}
+
+static QByteArray AckEnvelope(int size) {
+    Reflector::AckRequest req;
+    req.set_timestamp(std::string(size, '0'));
+    return Envelope(".Reflector.Service.ack", req.SerializeAsString());
+}
+
+template<typename Request>
+static QByteArray CalculatorEnvelope(const char *name) {
+    Request req;
+    req.set_lhs(123456);
+    req.set_rhs(789);
+    return Envelope(name, req.SerializeAsString());
+}
+
+static QByteArray HttpRequest(QByteArray body) {
+    QByteArray http = "POST / HTTP/1.1";
+    http.append("\r\n").append("Host: localhost:8088");
+    http.append("\r\n").append("Accept: */*");
+    http.append("\r\n").append("Connection: keep-alive");
+    http.append("\r\n").append("Content-Type: application/octet-stream");
+    http.append("\r\n").append("Content-Length: ").append(QByteArray::number(body.length()));
+    http.append("\r\n").append("\r\n").append(body);
+    return http;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+static void BM_ParseEnvelope(benchmark::State &state) {
+    QByteArray bytes = AckEnvelope(int(state.range(0)));
+    Rpc_Request rpc_req;
+    for (auto _ : state) {
+        bool parsed = rpc_req.ParseFromArray(bytes.constData(), bytes.length());
+        benchmark::DoNotOptimize(parsed);
+    }
+    state.SetBytesProcessed(state.iterations() * bytes.length());
+}
+BENCHMARK(BM_ParseEnvelope)->RangeMultiplier(16)->Range(16, 64 << 10);
+
+static void BM_ProcessAck(benchmark::State &state) {
+    QByteArray bytes = AckEnvelope(int(state.range(0)));
+    RpcTask rpc_task(bytes);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(rpc_task.process(bytes));
+    }
+    state.SetBytesProcessed(state.iterations() * bytes.length());
+}
+BENCHMARK(BM_ProcessAck)->RangeMultiplier(16)->Range(16, 64 << 10);
+
+template<typename Request>
+static void BM_ProcessCalculator(benchmark::State &state, const char *name) {
+    QByteArray bytes = CalculatorEnvelope<Request>(name);
+    RpcTask rpc_task(bytes);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(rpc_task.process(bytes));
+    }
+}
+BENCHMARK_CAPTURE(BM_ProcessCalculator<Calculator::AddRequest>, add, ".Calculator.Service.add");
+BENCHMARK_CAPTURE(BM_ProcessCalculator<Calculator::SubRequest>, sub, ".Calculator.Service.sub");
+BENCHMARK_CAPTURE(BM_ProcessCalculator<Calculator::MulRequest>, mul, ".Calculator.Service.mul");
+BENCHMARK_CAPTURE(BM_ProcessCalculator<Calculator::DivRequest>, div, ".Calculator.Service.div");
+
+static void BM_PutHeaders(benchmark::State &state) {
+    QByteArray bytes(int(state.range(0)), 'x');
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RpcHttp::PutHeaders(bytes));
+    }
+    state.SetBytesProcessed(state.iterations() * bytes.length());
+}
+BENCHMARK(BM_PutHeaders)->RangeMultiplier(16)->Range(16, 64 << 10);
+
+static void BM_GetBody(benchmark::State &state) {
+    QByteArray bytes = HttpRequest(AckEnvelope(int(state.range(0))));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RpcHttp::GetBody(bytes));
+    }
+    state.SetBytesProcessed(state.iterations() * bytes.length());
+}
+BENCHMARK(BM_GetBody)->RangeMultiplier(16)->Range(16, 64 << 10);
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+static std::vector<qint32> Values(int length, qint32 bound, quint32 seed = 0) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<qint32> uniform(0, bound - 1);
+    std::vector<qint32> values(size_t(length), 0);
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = uniform(random);
+    }
+    return values;
+}
+
+template<bool Scalar>
+static void BM_DecodeVarints(benchmark::State &state) {
+    std::vector<qint32> values = Values(64 << 10, qint32(state.range(0)));
+    std::vector<quint8> bytes(RpcVector::EncodedSize(values.data(), int(values.size())) + 16);
+    const quint8 *end = RpcVector::EncodeScalar(values.data(), int(values.size()), bytes.data());
+    std::vector<qint32> out(bytes.size() + 16);
+    for (auto _ : state) {
+        int length = 0;
+        benchmark::DoNotOptimize(Scalar
+            ? RpcVector::DecodeScalar(bytes.data(), end, out.data(), &length)
+            : RpcVector::Decode(bytes.data(), end, out.data(), &length));
+    }
+    state.SetBytesProcessed(state.iterations() * (end - bytes.data()));
+    state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK_TEMPLATE(BM_DecodeVarints, false)->RangeMultiplier(128)->Range(128, 1 << 28);
+BENCHMARK_TEMPLATE(BM_DecodeVarints, true)->RangeMultiplier(128)->Range(128, 1 << 28);
+
+template<bool Scalar>
+static void BM_EncodeVarints(benchmark::State &state) {
+    std::vector<qint32> values = Values(64 << 10, qint32(state.range(0)));
+    std::vector<quint8> bytes(RpcVector::EncodedSize(values.data(), int(values.size())) + 16);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Scalar
+            ? RpcVector::EncodeScalar(values.data(), int(values.size()), bytes.data())
+            : RpcVector::Encode(values.data(), int(values.size()), bytes.data()));
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK_TEMPLATE(BM_EncodeVarints, false)->RangeMultiplier(128)->Range(128, 1 << 28);
+BENCHMARK_TEMPLATE(BM_EncodeVarints, true)->RangeMultiplier(128)->Range(128, 1 << 28);
+
+static void BM_ProcessCalculatorBatch(benchmark::State &state) {
+    std::vector<qint32> lhs = Values(int(state.range(0)), 1 << 14, 1);
+    std::vector<qint32> rhs = Values(int(state.range(0)), 1 << 14, 2);
+    std::string data = RpcVector::Serialize(1, lhs.data(), int(lhs.size()))
+            + RpcVector::Serialize(2, rhs.data(), int(rhs.size()));
+
+    QByteArray bytes = Envelope(".Calculator.Service.addBatch", data);
+    RpcTask rpc_task(bytes);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(rpc_task.process(bytes));
+    }
+    state.SetBytesProcessed(state.iterations() * bytes.length());
+    state.SetItemsProcessed(state.iterations() * lhs.size());
+}
+BENCHMARK(BM_ProcessCalculatorBatch)->RangeMultiplier(16)->Range(16, 64 << 10);
+
+BENCHMARK_MAIN();
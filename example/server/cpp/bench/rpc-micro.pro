@@ -0,0 +1,58 @@
+#-------------------------------------------------
+#
+# Google Benchmark based micro benchmarks of the request path
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = rpc-micro
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += rpc-micro.cpp \
+    ../protocol/api.pb.cc \
+    ../protocol/calculator.pb.cc \
+    ../protocol/listener.pb.cc \
+    ../protocol/reflector.pb.cc \
+    ../protocol/rpc.pb.cc \
+    ../rpc-task.cpp \
+    ../rpc-http.cpp \
+    ../rpc-metrics.cpp \
+    ../rpc-histogram.cpp \
+    ../rpc-trace.cpp \
+    ../rpc-perf.cpp \
+    ../rpc-batch.cpp \
+    ../rpc-pipeline.cpp \
+    ../rpc-vector.cpp \
+    ../rpc-eval.cpp \
+    ../rpc-memo.cpp \
+    ../rpc-flight.cpp \
+    ../rpc-executor.cpp
+
+HEADERS += \
+    ../protocol/api.pb.h \
+    ../protocol/calculator.pb.h \
+    ../protocol/listener.pb.h \
+    ../protocol/reflector.pb.h \
+    ../protocol/rpc.pb.h \
+    ../rpc-task.h \
+    ../rpc-http.h \
+    ../rpc-metrics.h \
+    ../rpc-histogram.h \
+    ../rpc-trace.h \
+    ../rpc-perf.h \
+    ../rpc-batch.h \
+    ../rpc-pipeline.h \
+    ../rpc-vector.h \
+    ../rpc-eval.h \
+    ../rpc-memo.h \
+    ../rpc-flight.h \
+    ../rpc-executor.h \
+    ../rpc-hash.h
+
+INCLUDEPATH += /usr/include $$PWD/..
+LIBS += -L/usr/lib/ -lbenchmark -lprotobuf -pthread  -lpthread
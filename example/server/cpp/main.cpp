@@ -1,8 +1,18 @@
 #include <QCoreApplication>
 #include <QtCore/QCommandLineParser>
 #include <QtCore/QCommandLineOption>
+#include <QtCore/QThreadPool>
 
 #include "rpc-server.h"
+#include "rpc-admin.h"
+#include "rpc-metrics.h"
+#include "rpc-trace.h"
+#include "rpc-log.h"
+#include "rpc-capture.h"
+#include "rpc-executor.h"
+#include "rpc-perf.h"
+#include "rpc-memo.h"
+#include "rpc-flight.h"
 
 int main(int argc, char *argv[]) {
     QCoreApplication app(argc, argv);
@@ -17,6 +27,11 @@ int main(int argc, char *argv[]) {
                 QStringList() << "l" << "logging",
                 QCoreApplication::translate("main", "Logging [default: false]"));
     parser.addOption(logging_opt);
+    QCommandLineOption log_sample_opt(
+                QStringList() << "log-sample",
+                QCoreApplication::translate("main", "Log only every N-th message [default: 1]"),
+                QCoreApplication::translate("main", "log-sample"), QStringLiteral("1"));
+    parser.addOption(log_sample_opt);
     QCommandLineOption xhr_port_opt(
                 QStringList() << "xhr-port",
                 QCoreApplication::translate("main", "XHR Server Port [default: 8088]"),
@@ -27,18 +42,173 @@ int main(int argc, char *argv[]) {
                 QCoreApplication::translate("main", "WS Server Port [default: 8089]"),
                 QCoreApplication::translate("main", "ws-port"), QStringLiteral("8089"));
     parser.addOption(ws_port_opt);
+    QCommandLineOption ws_engine_opt(
+                QStringList() << "ws-engine",
+                QCoreApplication::translate("main", "WS Engine: qt or raw [default: qt]"),
+                QCoreApplication::translate("main", "ws-engine"), QStringLiteral("qt"));
+    parser.addOption(ws_engine_opt);
+    QCommandLineOption ws_deflate_opt(
+                QStringList() << "ws-deflate",
+                QCoreApplication::translate("main", "WS permessage-deflate [default: false]"));
+    parser.addOption(ws_deflate_opt);
+    QCommandLineOption ws_deflate_min_opt(
+                QStringList() << "ws-deflate-min",
+                QCoreApplication::translate("main", "WS Deflate Minimum Message Size [default: 1024]"),
+                QCoreApplication::translate("main", "ws-deflate-min"), QStringLiteral("1024"));
+    parser.addOption(ws_deflate_min_opt);
+    QCommandLineOption xhr_timeout_opt(
+                QStringList() << "xhr-idle-timeout",
+                QCoreApplication::translate("main", "XHR Idle Timeout in seconds; 0 disables [default: 60]"),
+                QCoreApplication::translate("main", "xhr-idle-timeout"), QStringLiteral("60"));
+    parser.addOption(xhr_timeout_opt);
+    QCommandLineOption ws_timeout_opt(
+                QStringList() << "ws-idle-timeout",
+                QCoreApplication::translate("main", "WS Idle Timeout in seconds; 0 disables [default: 0]"),
+                QCoreApplication::translate("main", "ws-idle-timeout"), QStringLiteral("0"));
+    parser.addOption(ws_timeout_opt);
+    QCommandLineOption admin_port_opt(
+                QStringList() << "admin-port",
+                QCoreApplication::translate("main", "Admin Server Port serving /metrics; 0 disables [default: 0]"),
+                QCoreApplication::translate("main", "admin-port"), QStringLiteral("0"));
+    parser.addOption(admin_port_opt);
+    QCommandLineOption trace_opt(
+                QStringList() << "trace",
+                QCoreApplication::translate("main", "Trace request stages, served on /trace of the admin port [default: false]"));
+    parser.addOption(trace_opt);
+    QCommandLineOption capture_opt(
+                QStringList() << "capture",
+                QCoreApplication::translate("main", "Capture inbound requests to a file [default: none]"),
+                QCoreApplication::translate("main", "capture"));
+    parser.addOption(capture_opt);
+    QCommandLineOption queue_alert_opt(
+                QStringList() << "queue-alert-ms",
+                QCoreApplication::translate("main", "Warn once queue waits exceed milli-seconds; 0 disables [default: 0]"),
+                QCoreApplication::translate("main", "queue-alert-ms"), QStringLiteral("0"));
+    parser.addOption(queue_alert_opt);
+    QCommandLineOption threads_opt(
+                QStringList() << "threads",
+                QCoreApplication::translate("main", "Worker Threads; 0 for one per core [default: 0]"),
+                QCoreApplication::translate("main", "threads"), QStringLiteral("0"));
+    parser.addOption(threads_opt);
+    QCommandLineOption perf_opt(
+                QStringList() << "perf-counters",
+                QCoreApplication::translate("main", "Count cycles, instructions, cache and branch misses per method on /metrics [default: false]"));
+    parser.addOption(perf_opt);
+    QCommandLineOption memoize_opt(
+                QStringList() << "memoize",
+                QCoreApplication::translate("main", "Cache results of these (comma separated) pure methods [default: none]"),
+                QCoreApplication::translate("main", "memoize"));
+    parser.addOption(memoize_opt);
+    QCommandLineOption memoize_size_opt(
+                QStringList() << "memoize-size",
+                QCoreApplication::translate("main", "Result Cache Size in entries [default: 65536]"),
+                QCoreApplication::translate("main", "memoize-size"), QStringLiteral("65536"));
+    parser.addOption(memoize_size_opt);
+    QCommandLineOption coalesce_opt(
+                QStringList() << "coalesce",
+                QCoreApplication::translate("main", "Compute identical in-flight requests of these (comma separated) methods once [default: none]"),
+                QCoreApplication::translate("main", "coalesce"));
+    parser.addOption(coalesce_opt);
+    QCommandLineOption priority_opt(
+                QStringList() << "priority",
+                QCoreApplication::translate("main", "Priority classes of methods as (comma separated) method:high|normal|low [default: none]"),
+                QCoreApplication::translate("main", "priority"));
+    parser.addOption(priority_opt);
+    QCommandLineOption priority_weights_opt(
+                QStringList() << "priority-weights",
+                QCoreApplication::translate("main", "Worker shares of the high, normal and low priority classes [default: 8,4,1]"),
+                QCoreApplication::translate("main", "priority-weights"), QStringLiteral("8,4,1"));
+    parser.addOption(priority_weights_opt);
     parser.process(app);
 
     bool logging = parser.isSet(logging_opt);
     Q_ASSERT(logging == true || logging == false);
+    int log_sample = parser.value(log_sample_opt).toInt();
+    Q_ASSERT(log_sample > 0);
     int port_xhr = parser.value(xhr_port_opt).toInt();
     Q_ASSERT(port_xhr);
     int port_ws = parser.value(ws_port_opt).toInt();
     Q_ASSERT(port_ws);
+    int ws_deflate = parser.isSet(ws_deflate_opt)
+            ? parser.value(ws_deflate_min_opt).toInt() : -1;
+    Q_ASSERT(ws_deflate >= -1);
+    bool ws_raw = parser.value(ws_engine_opt) == QStringLiteral("raw");
+    Q_ASSERT(ws_raw || parser.value(ws_engine_opt) == QStringLiteral("qt"));
+    int port_admin = parser.value(admin_port_opt).toInt();
+    Q_ASSERT(port_admin >= 0);
+    int threads = parser.value(threads_opt).toInt();
+    Q_ASSERT(threads >= 0);
+    if (threads > 0) {
+        QThreadPool::globalInstance()->setMaxThreadCount(threads);
+    }
 
-    RpcServer *server = new RpcServer(port_xhr, port_ws);
+    RpcServer *server = new RpcServer(port_xhr, port_ws, ws_raw, ws_deflate);
     server->setLogging(logging);
+    if (logging) {
+        RpcLog::instance()->setSample(log_sample);
+        RpcLog::instance()->start(QThread::LowPriority);
+    }
+    server->setTcpTimeout(parser.value(xhr_timeout_opt).toInt());
+    server->setWsTimeout(parser.value(ws_timeout_opt).toInt());
+    server->getExecutor()->setAlertMs(parser.value(queue_alert_opt).toInt());
+
+    if (parser.isSet(memoize_opt)) {
+        RpcMemo::instance()->setCapacity(parser.value(memoize_size_opt).toInt());
+        RpcMemo::instance()->setMethods(parser.value(memoize_opt).split(','));
+    }
+    if (parser.isSet(coalesce_opt)) {
+        RpcFlight::instance()->setMethods(parser.value(coalesce_opt).split(','));
+    }
+    if (parser.isSet(priority_opt)) {
+        foreach (const QString &entry, parser.value(priority_opt).split(',')) {
+            int colon = entry.lastIndexOf(':');
+            RpcExecutor::Priority priority;
+            bool parsed = colon > 0 && RpcExecutor::parsePriority(
+                        entry.mid(colon + 1).trimmed(), &priority);
+            Q_ASSERT(parsed);
+            if (parsed) {
+                server->getExecutor()->setPriority(
+                            entry.left(colon).trimmed().toUtf8(), priority);
+            }
+        }
+    }
+    QStringList weights = parser.value(priority_weights_opt).split(',');
+    Q_ASSERT(weights.size() == RpcExecutor::N_PRIORITIES);
+    for (int i = 0; i < qMin(weights.size(), int(RpcExecutor::N_PRIORITIES)); i++) {
+        int weight = weights[i].toInt();
+        Q_ASSERT(weight > 0);
+        server->getExecutor()->setWeight(RpcExecutor::Priority(i), qMax(weight, 1));
+    }
+
+    RpcCapture *capture = NULL;
+    if (parser.isSet(capture_opt)) {
+        capture = new RpcCapture(parser.value(capture_opt));
+        Q_ASSERT(capture);
+        server->setCapture(capture);
+    }
+
+    if (port_admin > 0) {
+        RpcMetrics::setEnabled(true);
+        RpcPerf::setEnabled(parser.isSet(perf_opt));
+        RpcAdmin *admin = new RpcAdmin(port_admin, server);
+        admin->route("/metrics", "text/plain; version=0.0.4", [server]() {
+            return RpcMetrics::instance()->prometheus()
+                    .append(server->getExecutor()->prometheus())
+                    .append(RpcMemo::instance()->prometheus())
+                    .append(RpcFlight::instance()->prometheus());
+        });
+        if (parser.isSet(trace_opt)) {
+            RpcTrace::setEnabled(true);
+            admin->route("/trace", "application/json", []() {
+                return RpcTrace::chrome();
+            });
+        }
+    }
 
     QObject::connect(server, &RpcServer::closed, &app, &QCoreApplication::quit);
-    return app.exec();
+    int result = app.exec();
+    server->setCapture(NULL);
+    delete capture;
+    RpcLog::instance()->stop();
+    return result;
 }
@@ -0,0 +1,99 @@
+#include "rpc-admin.h"
+
+#include <QtCore/QList>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+#define RPC_ADMIN_MAX_REQUEST 8192
+
+RpcAdmin::RpcAdmin(quint16 port, QObject *parent)
+    : QObject(parent)
+{
+    m_server = new QTcpServer(this);
+    Q_ASSERT(m_server);
+    bool listening = m_server->listen(QHostAddress::Any, port);
+    Q_ASSERT(listening);
+
+    QObject::connect(
+                m_server, &QTcpServer::newConnection, this, &RpcAdmin::onConnection);
+}
+
+RpcAdmin::~RpcAdmin() {
+    m_server->close();
+    Q_ASSERT(!m_server->isListening());
+}
+
+void RpcAdmin::route(QByteArray path, QByteArray content_type, Handler handler) {
+    Route route;
+    route.content_type = content_type;
+    route.handler = handler;
+    m_routes.insert(path, route);
+}
+
+void RpcAdmin::onConnection() {
+    while (m_server->hasPendingConnections()) {
+        QTcpSocket *socket = m_server->nextPendingConnection();
+        Q_ASSERT(socket);
+
+        QObject::connect(
+                    socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            if (onRequest(socket)) {
+                QObject::disconnect(socket, &QTcpSocket::readyRead, this, 0);
+            }
+        });
+        QObject::connect(
+                    socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+bool RpcAdmin::onRequest(QTcpSocket *socket) {
+    QByteArray head = socket->peek(RPC_ADMIN_MAX_REQUEST);
+    int end = head.indexOf("\r\n\r\n");
+    if (end < 0) {
+        if (head.length() >= RPC_ADMIN_MAX_REQUEST) {
+            reply(socket, "431 Request Header Fields Too Large", "text/plain", QByteArray());
+            return true;
+        }
+        return false;
+    }
+    socket->read(end + 4);
+
+    QList<QByteArray> line = head.left(head.indexOf("\r\n")).split(' ');
+    if (line.length() != 3) {
+        reply(socket, "400 Bad Request", "text/plain", QByteArray());
+        return true;
+    }
+    if (line[0] != "GET") {
+        reply(socket, "405 Method Not Allowed", "text/plain", QByteArray());
+        return true;
+    }
+
+    QByteArray path = line[1].left(line[1].indexOf('?'));
+    if (!m_routes.contains(path)) {
+        reply(socket, "404 Not Found", "text/plain", QByteArray());
+        return true;
+    }
+
+    const Route &route = m_routes[path];
+    reply(socket, "200 OK", route.content_type, route.handler());
+    return true;
+}
+
+void RpcAdmin::reply(QTcpSocket *socket, QByteArray status, QByteArray content_type, QByteArray body) {
+    QByteArray response = "HTTP/1.1 ";
+    response.append(status);
+    response.append("\r\n")
+            .append("Content-Type: ")
+            .append(content_type);
+    response.append("\r\n")
+            .append("Content-Length: ")
+            .append(QByteArray::number(body.length()));
+    response.append("\r\n")
+            .append("Connection: ")
+            .append("close");
+    response.append("\r\n")
+            .append("\r\n");
+
+    socket->write(response.append(body));
+    socket->disconnectFromHost();
+}
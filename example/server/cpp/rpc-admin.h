@@ -0,0 +1,45 @@
+#ifndef RPC_ADMIN_H
+#define RPC_ADMIN_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+
+#include <functional>
+
+QT_FORWARD_DECLARE_CLASS(QTcpServer)
+QT_FORWARD_DECLARE_CLASS(QTcpSocket)
+
+//
+// Admin HTTP endpoint on its own port, which answers GET requests for the
+// registered paths (like `/metrics`) with the output of their handlers. The
+// handlers run on the thread of the admin server, i.e. off the worker pool.
+//
+
+class RpcAdmin : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<QByteArray()> Handler;
+
+    explicit RpcAdmin(quint16 port, QObject *parent = 0);
+    ~RpcAdmin();
+
+    void route(QByteArray path, QByteArray content_type, Handler handler);
+
+private Q_SLOTS:
+    void onConnection();
+private:
+    bool onRequest(QTcpSocket *socket);
+    void reply(QTcpSocket *socket, QByteArray status, QByteArray content_type, QByteArray body);
+
+private:
+    struct Route {
+        QByteArray content_type;
+        Handler handler;
+    };
+    QHash<QByteArray, Route> m_routes;
+    QTcpServer *m_server;
+};
+
+#endif // RPC_ADMIN_H
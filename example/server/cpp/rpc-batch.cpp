@@ -0,0 +1,180 @@
+#include "rpc-batch.h"
+#include "rpc-task.h"
+#include "rpc-executor.h"
+#include "rpc-usdt.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QVector>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+#define RPC_BATCH_CHUNK 16
+
+// Rpc.Batch: repeated Request requests = 1, repeated Response responses = 2
+#define RPC_BATCH_REQUESTS_TAG 0x0a
+#define RPC_BATCH_RESPONSES_TAG 0x12
+
+class RpcBatchChunk : public QRunnable
+{
+public:
+    RpcBatchChunk(const QByteArray *requests, QByteArray *responses, int length,
+                  quint64 client, const RpcToken *token, QSemaphore *done)
+        : m_requests(requests), m_responses(responses), m_length(length),
+          m_client(client), m_token(token), m_done(done) {
+        setAutoDelete(false);
+    }
+
+    void run() {
+        RpcTask task(QByteArray(), m_client);
+        task.setNested(true);
+
+        for (int i = 0; i < m_length; i++) {
+            if (m_token && m_token->cancelled()) {
+                break;
+            }
+            try {
+#ifdef RPC_USDT
+                RpcHeader header; // for the probes of the sub-request
+                RpcTask::Peek(m_requests[i], &header);
+                task.setHeader(header);
+#endif
+                m_responses[i] = task.process(m_requests[i]);
+            } catch (RpcException &ex) {
+                qWarning() << "[on:error]" << ex.m_message;
+            }
+        }
+        if (m_done) {
+            m_done->release();
+        }
+    }
+
+private:
+    const QByteArray *m_requests;
+    QByteArray *m_responses;
+    int m_length;
+    quint64 m_client;
+    const RpcToken *m_token;
+    QSemaphore *m_done;
+};
+
+RpcBatch::RpcBatch(RpcExecutor *executor, quint64 client)
+    : m_executor(executor), m_client(client), m_chunk_size(RPC_BATCH_CHUNK), m_token(NULL)
+{
+}
+
+QByteArray RpcBatch::process(const std::string &data) {
+    QVector<QByteArray> requests = slice(data);
+    QVector<QByteArray> responses;
+    run(requests, &responses);
+    return join(responses);
+}
+
+void RpcBatch::run(const QVector<QByteArray> &requests, QVector<QByteArray> *responses) {
+    Q_ASSERT(responses);
+    responses->fill(QByteArray(), requests.size());
+    const QByteArray *req_array = requests.constData();
+    QByteArray *res_array = responses->data();
+
+    int n_chunks = m_executor ? qMin(
+                (requests.size() + m_chunk_size - 1) / m_chunk_size,
+                qMax(m_executor->threads(), 1)) : 1;
+    if (n_chunks <= 1) {
+        RpcBatchChunk(req_array, res_array, requests.size(), m_client, m_token, NULL).run();
+        return;
+    }
+
+    //
+    // Chunks of (almost) equal length; the first one is run by this thread:
+    //
+
+    QSemaphore done;
+    QList<RpcBatchChunk*> chunks;
+    for (int i = 0, offset = 0; i < n_chunks; i++) {
+        int length = (requests.size() - offset) / (n_chunks - i);
+        RpcBatchChunk *chunk = new RpcBatchChunk(
+                    req_array + offset, res_array + offset, length, m_client, m_token, &done);
+        Q_ASSERT(chunk);
+        chunks << chunk;
+        offset += length;
+    }
+
+    //
+    // The others queue like the batch's own task (in its class and flow),
+    // hence a low priority batch cannot occupy workers ahead of others:
+    //
+
+    RpcExecutor::Priority priority = m_token
+            ? RpcExecutor::Priority(m_token->priority()) : RpcExecutor::Normal;
+    quint64 flow = m_token ? m_token->flow() : m_client;
+
+    QVector<QSharedPointer<RpcToken> > tokens(n_chunks);
+    for (int i = 1; i < n_chunks; i++) {
+        tokens[i] = QSharedPointer<RpcToken>(new RpcToken());
+        m_executor->start(chunks[i], tokens[i], priority, flow);
+    }
+
+    chunks[0]->run();
+    for (int i = n_chunks - 1; i > 0; i--) {
+        if (m_executor->take(tokens[i])) {
+            chunks[i]->run();
+        }
+    }
+    done.acquire(n_chunks);
+
+    qDeleteAll(chunks);
+}
+
+QVector<QByteArray> RpcBatch::slice(const std::string &data) {
+    QVector<QByteArray> requests;
+    CodedInputStream input(
+                reinterpret_cast<const quint8*>(data.data()), int(data.size()));
+
+    while (quint32 tag = input.ReadTag()) {
+        if (tag == RPC_BATCH_REQUESTS_TAG) {
+            quint32 length;
+            if (!input.ReadVarint32(&length)) {
+                break;
+            }
+            int offset = input.CurrentPosition();
+            if (!input.Skip(int(length))) {
+                break;
+            }
+            requests << QByteArray::fromRawData(data.data() + offset, int(length));
+        } else if (!WireFormatLite::SkipField(&input, tag)) {
+            break;
+        }
+    }
+    return requests;
+}
+
+QByteArray RpcBatch::join(const QVector<QByteArray> &responses) {
+    int size = 0;
+    foreach (const QByteArray &response, responses) {
+        if (!response.isEmpty()) {
+            size += 1 + CodedOutputStream::VarintSize32(quint32(response.length()))
+                    + response.length();
+        }
+    }
+
+    QByteArray batch(size, 0);
+    quint8 *target = reinterpret_cast<quint8*>(batch.data());
+    foreach (const QByteArray &response, responses) {
+        if (!response.isEmpty()) {
+            *target++ = RPC_BATCH_RESPONSES_TAG;
+            target = CodedOutputStream::WriteVarint32ToArray(
+                        quint32(response.length()), target);
+            memcpy(target, response.constData(), size_t(response.length()));
+            target += response.length();
+        }
+    }
+    Q_ASSERT(target == reinterpret_cast<quint8*>(batch.data()) + size);
+    return batch;
+}
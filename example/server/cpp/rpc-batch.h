@@ -0,0 +1,53 @@
+#ifndef RPC_BATCH_H
+#define RPC_BATCH_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QVector>
+
+#include <string>
+
+class RpcExecutor;
+class RpcToken;
+
+//
+// Processes the requests of an `Rpc.Batch` and returns the serialized batch
+// of their responses (in request order, omitting the failed ones). Requests
+// are sliced out of the batch without copying, then split into chunks: The
+// calling worker runs the first chunk itself, the others are submitted to
+// the executor (in the priority class and flow of the batch's token), and
+// any of them no worker has picked up yet are taken back and run inline as
+// well. Hence a batch completes even on a fully busy pool, but cannot grab
+// workers ahead of other classes. Without an executor all chunks are run
+// inline. Once its token is cancelled, the requests not yet processed are
+// failed.
+//
+
+class RpcBatch
+{
+public:
+    explicit RpcBatch(RpcExecutor *executor, quint64 client = 0);
+
+    QByteArray process(const std::string &data);
+    void run(const QVector<QByteArray> &requests, QVector<QByteArray> *responses);
+
+    static QVector<QByteArray> slice(const std::string &data);
+    static QByteArray join(const QVector<QByteArray> &responses);
+
+private:
+    RpcExecutor *m_executor;
+    quint64 m_client;
+
+private:
+    int m_chunk_size;
+public:
+    int getChunkSize() { return m_chunk_size; }
+    void setChunkSize(int value) { m_chunk_size = value; }
+
+private:
+    const RpcToken *m_token;
+public:
+    const RpcToken *getToken() { return m_token; }
+    void setToken(const RpcToken *value) { m_token = value; }
+};
+
+#endif // RPC_BATCH_H
@@ -0,0 +1,139 @@
+#include "rpc-capture.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+
+#include <cstring>
+
+#define RPC_CAPTURE_CHUNK (qint64(64) << 20)
+
+const char RpcCapture::MAGIC[8] = {'R', 'P', 'C', 'C', 'A', 'P', '0', '1'};
+
+RpcCapture::RpcCapture(QString path)
+    : m_file(path), m_map(NULL), m_offset(0), m_mapped(0), m_size(0)
+{
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        qWarning() << "[capture]" << path << m_file.errorString();
+        return;
+    }
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.started = QDateTime::currentMSecsSinceEpoch();
+    qint64 written = m_file.write((const char*)&header, sizeof(header));
+    Q_ASSERT(written == sizeof(header));
+    bool flushed = m_file.flush();
+    Q_ASSERT(flushed);
+
+    m_size = sizeof(header);
+    m_clock.start();
+}
+
+RpcCapture::~RpcCapture() {
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+    if (m_file.isOpen()) {
+        m_file.resize(m_size);
+        m_file.close();
+    }
+}
+
+bool RpcCapture::append(Transport transport, quint64 connection, const QByteArray &bytes) {
+    if (!m_file.isOpen() || bytes.isEmpty()) {
+        return false;
+    }
+
+    qint64 size = sizeof(Record) + bytes.length();
+    if (m_map == NULL || m_size + size > m_offset + m_mapped) {
+        if (!remap(m_size + size)) {
+            qWarning() << "[capture]" << m_file.fileName() << m_file.errorString();
+            m_file.close();
+            return false;
+        }
+    }
+
+    Record record;
+    record.length = quint32(bytes.length());
+    record.transport = quint32(transport);
+    record.timestamp = m_clock.nsecsElapsed();
+    record.connection = connection;
+
+    uchar *at = m_map + (m_size - m_offset);
+    memcpy(at, &record, sizeof(record));
+    memcpy(at + sizeof(record), bytes.constData(), size_t(bytes.length()));
+    m_size += size;
+
+    return true;
+}
+
+bool RpcCapture::remap(qint64 end) {
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = NULL;
+    }
+
+    m_offset = m_size;
+    m_mapped = qMax(RPC_CAPTURE_CHUNK, end - m_offset);
+    if (!m_file.resize(m_offset + m_mapped)) {
+        return false;
+    }
+
+    m_map = m_file.map(m_offset, m_mapped);
+    return m_map != NULL;
+}
+
+RpcCaptureReader::RpcCaptureReader(QString path)
+    : m_file(path), m_map(NULL), m_size(0), m_at(0), m_started(0)
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "[capture]" << path << m_file.errorString();
+        return;
+    }
+
+    m_size = m_file.size();
+    if (m_size < qint64(sizeof(RpcCapture::Header))) {
+        qWarning() << "[capture]" << path << "truncated";
+        return;
+    }
+
+    m_map = m_file.map(0, m_size);
+    if (m_map == NULL) {
+        qWarning() << "[capture]" << path << m_file.errorString();
+        return;
+    }
+
+    RpcCapture::Header header;
+    memcpy(&header, m_map, sizeof(header));
+    if (memcmp(header.magic, RpcCapture::MAGIC, sizeof(header.magic)) != 0) {
+        qWarning() << "[capture]" << path << "not a capture";
+        m_file.unmap(m_map);
+        m_map = NULL;
+        return;
+    }
+
+    m_started = header.started;
+    m_at = sizeof(header);
+}
+
+RpcCaptureReader::~RpcCaptureReader() {
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+}
+
+bool RpcCaptureReader::next(RpcCapture::Record *record, QByteArray *bytes) {
+    Q_ASSERT(record && bytes);
+    if (m_map == NULL || m_at + qint64(sizeof(*record)) > m_size) {
+        return false;
+    }
+
+    memcpy(record, m_map + m_at, sizeof(*record));
+    if (record->length == 0 || m_at + qint64(sizeof(*record)) + record->length > m_size) {
+        return false;
+    }
+
+    *bytes = QByteArray((const char*)m_map + m_at + sizeof(*record), int(record->length));
+    m_at += sizeof(*record) + record->length;
+    return true;
+}
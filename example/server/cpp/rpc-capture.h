@@ -0,0 +1,72 @@
+#ifndef RPC_CAPTURE_H
+#define RPC_CAPTURE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+//
+// Append only capture of inbound requests: The file starts with a header
+// (magic and wall clock start), followed by records of a fixed size head
+// plus the raw `Rpc.Request` envelope. Records are copied into a mapping of
+// the file, which grows in chunks, hence appending costs no system calls
+// and what has been captured survives a crash of the process. A record
+// with a zero length marks the end (of a file that was not closed).
+//
+
+class RpcCapture
+{
+public:
+    enum Transport { Xhr = 0, Ws = 1 };
+
+    struct Header {
+        char magic[8];
+        qint64 started; // [ms since epoch]
+    };
+    struct Record {
+        quint32 length;
+        quint32 transport;
+        qint64 timestamp; // [ns since start]
+        quint64 connection;
+    };
+    static const char MAGIC[8];
+
+public:
+    explicit RpcCapture(QString path);
+    ~RpcCapture();
+
+    bool isOpen() const { return m_file.isOpen(); }
+    bool append(Transport transport, quint64 connection, const QByteArray &bytes);
+
+private:
+    bool remap(qint64 end);
+
+private:
+    QFile m_file;
+    QElapsedTimer m_clock;
+    uchar *m_map;
+    qint64 m_offset;
+    qint64 m_mapped;
+    qint64 m_size;
+};
+
+class RpcCaptureReader
+{
+public:
+    explicit RpcCaptureReader(QString path);
+    ~RpcCaptureReader();
+
+    bool isValid() const { return m_map != NULL; }
+    qint64 started() const { return m_started; }
+    bool next(RpcCapture::Record *record, QByteArray *bytes);
+
+private:
+    QFile m_file;
+    uchar *m_map;
+    qint64 m_size;
+    qint64 m_at;
+    qint64 m_started;
+};
+
+#endif // RPC_CAPTURE_H
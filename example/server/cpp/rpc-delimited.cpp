@@ -0,0 +1,48 @@
+#include "rpc-delimited.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <cstring>
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+
+QList<QByteArray> RpcDelimited::Split(QByteArray bytes) {
+    CodedInputStream stream(
+                (const quint8*)bytes.constData(), bytes.length());
+
+    QList<QByteArray> list;
+    quint32 size;
+    while (stream.ReadVarint32(&size)) {
+        int offset = stream.CurrentPosition();
+        if (size > quint32(bytes.length() - offset)) {
+            return QList<QByteArray>(); // truncated: reject the whole frame
+        }
+        list << bytes.mid(offset, size);
+        bool skipped = stream.Skip(size);
+        Q_ASSERT(skipped);
+    }
+
+    return list;
+}
+
+QByteArray RpcDelimited::Join(QList<QByteArray> list) {
+    int length = 0;
+    foreach(QByteArray bytes, list) {
+        length += CodedOutputStream::VarintSize32(bytes.length());
+        length += bytes.length();
+    }
+
+    QByteArray array(length, 0);
+    quint8 *target = (quint8*)array.data();
+    foreach(QByteArray bytes, list) {
+        target = CodedOutputStream::WriteVarint32ToArray(bytes.length(), target);
+        memcpy(target, bytes.constData(), bytes.length());
+        target += bytes.length();
+    }
+    Q_ASSERT(target == (quint8*)array.data() + length);
+
+    return array;
+}
@@ -0,0 +1,12 @@
+#ifndef RPC_DELIMITED_H
+#define RPC_DELIMITED_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+namespace RpcDelimited {
+    QList<QByteArray> Split(QByteArray bytes);
+    QByteArray Join(QList<QByteArray> list);
+}
+
+#endif // RPC_DELIMITED_H
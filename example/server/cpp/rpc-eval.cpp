@@ -0,0 +1,406 @@
+#include "rpc-eval.h"
+#include "rpc-hash.h"
+#include "rpc-task.h"
+#include "rpc-vector.h"
+
+#include "protocol/calculator.pb.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QReadLocker>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QWriteLocker>
+
+#include <algorithm>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+#define RPC_EVAL_MAX_VARIABLES 4096
+#define RPC_EVAL_MAX_REGISTERS 65535
+#define RPC_EVAL_MAX_CELLS (1 << 24)
+#define RPC_EVAL_CACHE 4096
+
+namespace {
+    QReadWriteLock g_lock;
+    QHash<quint64, QSharedPointer<const RpcProgram> > g_programs;
+
+    qint32 Fold(int opcode, qint32 lhs, qint32 rhs) {
+        switch (opcode) {
+        case RpcProgram::Add:
+            return qint32(quint32(lhs) + quint32(rhs));
+        case RpcProgram::Sub:
+            return qint32(quint32(lhs) - quint32(rhs));
+        case RpcProgram::Mul:
+            return qint32(quint32(lhs) * quint32(rhs));
+        default:
+            if (rhs == 0) {
+                throw RpcException(".Calculator.Service.eval: division by zero");
+            }
+            return rhs == -1 ? qint32(0u - quint32(lhs)) : lhs / rhs;
+        }
+    }
+}
+
+//
+// Compiles into symbolic operands first, since the number of variables (and
+// hence the first constant and temporary register) is only known at the end.
+//
+
+class RpcCompiler
+{
+public:
+    struct Operand {
+        enum Kind {
+            Constant, Variable, Temporary
+        };
+        Operand(Kind kind = Constant, qint32 value = 0) : kind(kind), value(value) {}
+        Kind kind;
+        qint32 value; // constant, or variable/temporary index
+    };
+    struct Instruction {
+        int opcode;
+        Operand dst, lhs, rhs;
+    };
+
+    RpcCompiler() : m_arity(0), m_temporaries(0) {}
+
+    Operand visit(const Calculator::Expr &expr) {
+        switch (expr.node_case()) {
+        case Calculator::Expr::kConstant:
+            return Operand(Operand::Constant, expr.constant());
+        case Calculator::Expr::kVariable:
+            if (expr.variable() >= RPC_EVAL_MAX_VARIABLES) {
+                throw RpcException(".Calculator.Service.eval: too many variables");
+            }
+            m_arity = qMax(m_arity, int(expr.variable()) + 1);
+            return Operand(Operand::Variable, qint32(expr.variable()));
+        case Calculator::Expr::kBinary:
+            return visit(expr.binary());
+        default:
+            throw RpcException(".Calculator.Service.eval: invalid expression");
+        }
+    }
+
+    Operand visit(const Calculator::Expr_Binary &binary) {
+        if (!binary.has_lhs() || !binary.has_rhs() || binary.op() > Calculator::Expr::DIV) {
+            throw RpcException(".Calculator.Service.eval: invalid expression");
+        }
+        int opcode = int(binary.op());
+        Operand lhs = visit(binary.lhs());
+        Operand rhs = visit(binary.rhs());
+
+        if (lhs.kind == Operand::Constant && rhs.kind == Operand::Constant) {
+            return Operand(Operand::Constant, Fold(opcode, lhs.value, rhs.value));
+        }
+        if (rhs.kind == Operand::Constant) {
+            if (rhs.value == 0 && (opcode == RpcProgram::Add || opcode == RpcProgram::Sub)) {
+                return lhs;
+            }
+            if (rhs.value == 1 && (opcode == RpcProgram::Mul || opcode == RpcProgram::Div)) {
+                return lhs;
+            }
+            if (rhs.value == 0 && opcode == RpcProgram::Div) {
+                throw RpcException(".Calculator.Service.eval: division by zero");
+            }
+        }
+        if (lhs.kind == Operand::Constant) {
+            if ((lhs.value == 0 && opcode == RpcProgram::Add) ||
+                (lhs.value == 1 && opcode == RpcProgram::Mul)) {
+                return rhs;
+            }
+        }
+
+        //
+        // A temporary is consumed exactly once (the expression is a tree), so
+        // the result can take over an operand's temporary:
+        //
+
+        Instruction instruction;
+        instruction.opcode = opcode;
+        instruction.lhs = lhs;
+        instruction.rhs = rhs;
+        if (lhs.kind == Operand::Temporary) {
+            instruction.dst = lhs;
+            release(rhs);
+        } else if (rhs.kind == Operand::Temporary) {
+            instruction.dst = rhs;
+        } else {
+            instruction.dst = acquire();
+        }
+        m_code << instruction;
+        return instruction.dst;
+    }
+
+    QSharedPointer<RpcProgram> link(const Operand &result) {
+        QSharedPointer<RpcProgram> program(new RpcProgram());
+        program->m_arity = m_arity;
+
+        QHash<qint32, int> constants;
+        foreach (const Instruction &instruction, m_code) {
+            constant(instruction.lhs, &constants, program.data());
+            constant(instruction.rhs, &constants, program.data());
+        }
+        constant(result, &constants, program.data());
+
+        int base = m_arity + program->m_constants.size();
+        program->m_registers = base + m_temporaries;
+        if (program->m_registers > RPC_EVAL_MAX_REGISTERS) {
+            throw RpcException(".Calculator.Service.eval: expression too large");
+        }
+
+        foreach (const Instruction &instruction, m_code) {
+            RpcProgram::Instruction linked;
+            linked.opcode = quint8(instruction.opcode);
+            linked.dst = quint16(reg(instruction.dst, constants, base));
+            linked.lhs = quint16(reg(instruction.lhs, constants, base));
+            linked.rhs = quint16(reg(instruction.rhs, constants, base));
+            program->m_code << linked;
+        }
+        program->m_result = reg(result, constants, base);
+        return program;
+    }
+
+private:
+    Operand acquire() {
+        if (!m_free.isEmpty()) {
+            return Operand(Operand::Temporary, m_free.takeLast());
+        }
+        return Operand(Operand::Temporary, m_temporaries++);
+    }
+    void release(const Operand &operand) {
+        if (operand.kind == Operand::Temporary) {
+            m_free << operand.value;
+        }
+    }
+    void constant(const Operand &operand, QHash<qint32, int> *constants, RpcProgram *program) {
+        if (operand.kind == Operand::Constant && !constants->contains(operand.value)) {
+            constants->insert(operand.value, program->m_constants.size());
+            program->m_constants << operand.value;
+        }
+    }
+    int reg(const Operand &operand, const QHash<qint32, int> &constants, int base) const {
+        switch (operand.kind) {
+        case Operand::Variable:
+            return operand.value;
+        case Operand::Constant:
+            return m_arity + constants.value(operand.value);
+        default:
+            return base + operand.value;
+        }
+    }
+
+private:
+    int m_arity;
+    int m_temporaries;
+    QVector<qint32> m_free;
+    QVector<Instruction> m_code;
+};
+
+RpcProgram::RpcProgram()
+    : m_arity(0), m_registers(0), m_result(0) {
+}
+
+QSharedPointer<const RpcProgram> RpcProgram::compile(const Calculator::Expr &expr) {
+    RpcCompiler compiler;
+    RpcCompiler::Operand result = compiler.visit(expr);
+    return compiler.link(result);
+}
+
+QSharedPointer<const RpcProgram> RpcProgram::cached(const char *data, int size) {
+    quint64 hash = RpcHash(data, size_t(size));
+    {
+        QReadLocker locker(&g_lock);
+        QSharedPointer<const RpcProgram> program = g_programs.value(hash);
+        if (program && program->m_expr.compare(0, std::string::npos, data, size_t(size)) == 0) {
+            return program;
+        }
+    }
+
+    Calculator::Expr expr;
+    if (!expr.ParseFromArray(data, size)) {
+        throw RpcException(".Calculator.Service.eval: invalid expression");
+    }
+    QSharedPointer<RpcProgram> program = compile(expr).constCast<RpcProgram>();
+    program->m_expr.assign(data, size_t(size));
+
+    //
+    // Plain eviction: Once full the cache starts over, which only costs a
+    // recompilation per expression still in use.
+    //
+
+    QWriteLocker locker(&g_lock);
+    if (g_programs.size() >= RPC_EVAL_CACHE) {
+        g_programs.clear();
+    }
+    g_programs.insert(hash, program);
+    return program;
+}
+
+//
+// At most one operand of an instruction is a constant (else it had been
+// folded), and a constant divisor is not 0 (else compiling had failed).
+//
+
+void RpcProgram::run(qint32 *columns, int stride, int rows) const {
+    foreach (const Instruction &instruction, m_code) {
+        Q_ASSERT(!constant(instruction.dst));
+        Q_ASSERT(!constant(instruction.lhs) || !constant(instruction.rhs));
+        bool lhs_constant = constant(instruction.lhs);
+        bool rhs_constant = constant(instruction.rhs);
+        qint32 lhs_value = lhs_constant ? m_constants[instruction.lhs - m_arity] : 0;
+        qint32 rhs_value = rhs_constant ? m_constants[instruction.rhs - m_arity] : 0;
+        qint32 *dst = columns + size_t(column(instruction.dst)) * size_t(stride);
+        const qint32 *lhs = lhs_constant ? NULL : columns + size_t(column(instruction.lhs)) * size_t(stride);
+        const qint32 *rhs = rhs_constant ? NULL : columns + size_t(column(instruction.rhs)) * size_t(stride);
+
+        switch (instruction.opcode) {
+        case Add:
+            if (lhs_constant) {
+                RpcVector::Add(rhs, lhs_value, dst, rows);
+            } else if (rhs_constant) {
+                RpcVector::Add(lhs, rhs_value, dst, rows);
+            } else {
+                RpcVector::Add(lhs, rhs, dst, rows);
+            }
+            break;
+        case Sub:
+            if (lhs_constant) {
+                RpcVector::Sub(lhs_value, rhs, dst, rows);
+            } else if (rhs_constant) {
+                RpcVector::Sub(lhs, rhs_value, dst, rows);
+            } else {
+                RpcVector::Sub(lhs, rhs, dst, rows);
+            }
+            break;
+        case Mul:
+            if (lhs_constant) {
+                RpcVector::Mul(rhs, lhs_value, dst, rows);
+            } else if (rhs_constant) {
+                RpcVector::Mul(lhs, rhs_value, dst, rows);
+            } else {
+                RpcVector::Mul(lhs, rhs, dst, rows);
+            }
+            break;
+        default:
+            if (rhs_constant) {
+                Q_ASSERT(rhs_value != 0);
+                RpcVector::Div(lhs, rhs_value, dst, rows);
+                break;
+            }
+            if (std::find(rhs, rhs + rows, 0) != rhs + rows) {
+                throw RpcException(".Calculator.Service.eval: division by zero");
+            }
+            if (lhs_constant) {
+                RpcVector::Div(lhs_value, rhs, dst, rows);
+            } else {
+                RpcVector::Div(lhs, rhs, dst, rows);
+            }
+        }
+    }
+}
+
+RpcEval::RpcEval()
+    : m_columns(NULL), m_capacity(0) {
+}
+
+RpcEval::~RpcEval() {
+    qFreeAligned(m_columns);
+}
+
+std::string RpcEval::process(const std::string &data) {
+    const quint8 *bytes = reinterpret_cast<const quint8*>(data.data());
+    CodedInputStream input(bytes, int(data.size()));
+    const char *expr_data = NULL;
+    int expr_size = 0;
+    quint32 arity = 0;
+    bool has_arity = false;
+    m_inputs.clear();
+
+    while (quint32 tag = input.ReadTag()) {
+        int field = WireFormatLite::GetTagFieldNumber(tag);
+        WireFormatLite::WireType wire_type = WireFormatLite::GetTagWireType(tag);
+        quint32 length, value;
+        bool valid = true;
+
+        if (field == 1 && wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+            valid = input.ReadVarint32(&length);
+            expr_data = data.data() + input.CurrentPosition();
+            expr_size = int(length);
+            valid = valid && input.Skip(int(length));
+        } else if (field == 2 && wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+            valid = input.ReadVarint32(&length);
+            const quint8 *head = bytes + input.CurrentPosition();
+            valid = valid && input.Skip(int(length));
+            if (valid) {
+                int offset = m_inputs.size(), decoded = 0;
+                m_inputs.resize(offset + int(length) + 16);
+                valid = RpcVector::Decode(head, head + length, m_inputs.data() + offset, &decoded);
+                m_inputs.resize(offset + decoded);
+            }
+        } else if (field == 2 && wire_type == WireFormatLite::WIRETYPE_VARINT) {
+            valid = input.ReadVarint32(&value);
+            m_inputs << qint32(value);
+        } else if (field == 3 && wire_type == WireFormatLite::WIRETYPE_VARINT) {
+            valid = input.ReadVarint32(&arity);
+            has_arity = true;
+        } else {
+            valid = WireFormatLite::SkipField(&input, tag);
+        }
+        if (!valid) {
+            throw RpcException(".Calculator.Service.eval: invalid request");
+        }
+    }
+    if (!expr_data) {
+        throw RpcException(".Calculator.Service.eval: missing expression");
+    }
+    if (has_arity && (arity == 0 || arity > RPC_EVAL_MAX_VARIABLES)) {
+        throw RpcException(".Calculator.Service.eval: invalid arity");
+    }
+
+    QSharedPointer<const RpcProgram> program = RpcProgram::cached(expr_data, expr_size);
+    if (arity == 0) {
+        arity = quint32(program->arity());
+    }
+    if (arity < quint32(program->arity()) || (arity > 0 && m_inputs.size() % int(arity))) {
+        throw RpcException(".Calculator.Service.eval: inputs mismatch");
+    }
+
+    //
+    // Without variables there is a single row; else the rows are transposed
+    // into the variable columns (of a stride keeping each column aligned):
+    //
+
+    int rows = arity > 0 ? m_inputs.size() / int(arity) : 1;
+    if (qint64(rows) * qint64(program->columns()) > RPC_EVAL_MAX_CELLS) {
+        throw RpcException(".Calculator.Service.eval: too many inputs");
+    }
+    int stride = (rows + 7) & ~7;
+    size_t capacity = size_t(program->columns()) * size_t(stride);
+    if (capacity > m_capacity) {
+        qFreeAligned(m_columns);
+        m_columns = static_cast<qint32*>(qMallocAligned(capacity * sizeof(qint32), 32));
+        m_capacity = m_columns ? capacity : 0;
+        if (!m_columns) {
+            throw RpcException(".Calculator.Service.eval: out of memory");
+        }
+    }
+
+    for (int variable = 0; variable < program->arity(); variable++) {
+        qint32 *column = m_columns + size_t(variable) * size_t(stride);
+        const qint32 *row = m_inputs.constData() + variable;
+        for (int i = 0; i < rows; i++, row += arity) {
+            column[i] = *row;
+        }
+    }
+
+    program->run(m_columns, stride, rows);
+    if (program->constant(program->result())) {
+        m_inputs.fill(program->constants()[program->result() - program->arity()], rows);
+        return RpcVector::Serialize(1, m_inputs.constData(), rows);
+    }
+    return RpcVector::Serialize(
+                1, m_columns + size_t(program->column(program->result())) * size_t(stride), rows);
+}
@@ -0,0 +1,78 @@
+#ifndef RPC_EVAL_H
+#define RPC_EVAL_H
+
+#include <QtCore/QSharedPointer>
+#include <QtCore/QVector>
+
+#include <string>
+
+namespace Calculator {
+    class Expr;
+}
+
+//
+// Register VM for `Calculator.Service.eval`: An expression is compiled into
+// three-address instructions, after folding constant subtrees (and adding 0,
+// multiplying or dividing by 1). A register holds a whole column, i.e. one
+// value per input row, so each instruction is a single RpcVector kernel call
+// over all rows. Registers are numbered variables first, then constants and
+// then temporaries, which are reused once consumed; constants are scalars
+// broadcast by the kernels, i.e. only variables and temporaries get columns.
+//
+
+class RpcProgram
+{
+public:
+    enum Opcode {
+        Add, Sub, Mul, Div
+    };
+    struct Instruction {
+        quint8 opcode;
+        quint16 dst;
+        quint16 lhs;
+        quint16 rhs;
+    };
+
+    static QSharedPointer<const RpcProgram> compile(const Calculator::Expr &expr);
+    static QSharedPointer<const RpcProgram> cached(const char *data, int size);
+
+    int arity() const { return m_arity; }
+    int registers() const { return m_registers; }
+    int result() const { return m_result; }
+    int columns() const { return m_registers - m_constants.size(); }
+    bool constant(int reg) const { return reg >= m_arity && reg < m_arity + m_constants.size(); }
+    int column(int reg) const { return reg < m_arity ? reg : reg - m_constants.size(); }
+    const QVector<qint32> &constants() const { return m_constants; }
+    const QVector<Instruction> &code() const { return m_code; }
+
+    void run(qint32 *columns, int stride, int rows) const;
+
+private:
+    RpcProgram();
+    friend class RpcCompiler;
+
+    int m_arity;
+    int m_registers;
+    int m_result;
+    QVector<qint32> m_constants;
+    QVector<Instruction> m_code;
+    std::string m_expr; // serialized, to verify cache hits
+};
+
+class RpcEval
+{
+public:
+    RpcEval();
+    ~RpcEval();
+
+    std::string process(const std::string &data);
+
+private:
+    QVector<qint32> m_inputs;
+    qint32 *m_columns;
+    size_t m_capacity;
+
+    Q_DISABLE_COPY(RpcEval)
+};
+
+#endif // RPC_EVAL_H
@@ -0,0 +1,378 @@
+#include "rpc-executor.h"
+#include "rpc-metrics.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QList>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
+
+#define RPC_EXECUTOR_SAMPLE_MS 1000
+#define RPC_EXECUTOR_STRIDE (1 << 20)
+
+namespace {
+    const char *PRIORITY_NAMES[RpcExecutor::N_PRIORITIES] = {
+        "high", "normal", "low"
+    };
+    const int PRIORITY_WEIGHTS[RpcExecutor::N_PRIORITIES] = {
+        8, 4, 1
+    };
+}
+
+struct RpcExecutorItem
+{
+    QRunnable *task;
+    QSharedPointer<RpcToken> token;
+    qint64 queued;
+};
+
+struct RpcExecutorClass
+{
+    RpcExecutorClass() : weight(1), pass(0), size(0) {}
+
+    int weight;
+    quint64 pass; // virtual time of the next pick
+    int size;
+    QHash<quint64, QList<RpcExecutorItem> > flows;
+    QList<quint64> turns; // flows with items, in round robin order
+};
+
+class RpcExecutorJob : public QRunnable
+{
+public:
+    RpcExecutorJob(RpcExecutor *executor) : m_executor(executor) {
+        setAutoDelete(true);
+    }
+
+    void run() {
+        RpcExecutorItem item;
+        if (!m_executor->next(&item)) {
+            return; // one job per task, and this one's task got cancelled
+        }
+        m_executor->onStart(item.queued);
+        item.task->run();
+        if (item.task->autoDelete()) {
+            delete item.task;
+        }
+        if (item.token) {
+            item.token->m_state.storeRelease(RpcToken::Done);
+        }
+        m_executor->onDone();
+    }
+
+private:
+    RpcExecutor *m_executor;
+};
+
+RpcExecutor::RpcExecutor(QThreadPool *pool, QObject *parent)
+    : QObject(parent), m_pool(pool), m_pass(0), m_submitted(0), m_started(0), m_completed(0),
+      m_alerted(0), m_sampled(0), m_sampled_at(RpcMetrics::now()),
+      m_throughput(0.0), m_lag(0), m_alert_ms(0)
+{
+    Q_ASSERT(m_pool);
+    m_classes = new RpcExecutorClass[N_PRIORITIES];
+    Q_ASSERT(m_classes);
+    for (int i = 0; i < N_PRIORITIES; i++) {
+        m_classes[i].weight = PRIORITY_WEIGHTS[i];
+    }
+
+    m_timer = new QTimer(this);
+    Q_ASSERT(m_timer);
+    m_timer->setInterval(RPC_EXECUTOR_SAMPLE_MS);
+    m_timer->setTimerType(Qt::PreciseTimer);
+
+    QObject::connect(
+                m_timer, &QTimer::timeout, this, &RpcExecutor::onSample);
+
+    m_timer->start();
+}
+
+RpcExecutor::~RpcExecutor() {
+    m_pool->waitForDone();
+    delete[] m_classes;
+}
+
+RpcExecutor::Priority RpcExecutor::priority(const QByteArray &method, quint32 requested) const {
+    if (requested > 0 && requested <= quint32(N_PRIORITIES)) {
+        return Priority(requested - 1); // Rpc.Request.Priority
+    }
+    return m_priorities.value(method, Normal);
+}
+
+void RpcExecutor::setPriority(const QByteArray &method, Priority priority) {
+    m_priorities.insert(method, priority);
+}
+
+bool RpcExecutor::parsePriority(const QString &name, Priority *priority) {
+    Q_ASSERT(priority);
+    for (int i = 0; i < N_PRIORITIES; i++) {
+        if (name == QLatin1String(PRIORITY_NAMES[i])) {
+            *priority = Priority(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+int RpcExecutor::getWeight(Priority priority) const {
+    QMutexLocker locker(&m_mutex);
+    return m_classes[priority].weight;
+}
+
+void RpcExecutor::setWeight(Priority priority, int weight) {
+    Q_ASSERT(weight > 0);
+    QMutexLocker locker(&m_mutex);
+    m_classes[priority].weight = weight;
+}
+
+//
+// To be called from any thread, e.g. by a worker submitting batch chunks.
+//
+
+void RpcExecutor::start(QRunnable *task, const QSharedPointer<RpcToken> &token,
+                        Priority priority, quint64 flow) {
+    Q_ASSERT(task);
+    Q_ASSERT(priority >= 0 && priority < N_PRIORITIES);
+    RpcExecutorJob *job = new RpcExecutorJob(this);
+    Q_ASSERT(job);
+
+    RpcExecutorItem item;
+    item.task = task;
+    item.token = token;
+    item.queued = RpcMetrics::now();
+    if (token) {
+        token->m_priority = priority;
+        token->m_flow = flow;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        RpcExecutorClass &klass = m_classes[priority];
+        if (klass.size == 0) {
+            klass.pass = qMax(klass.pass, m_pass); // no credit for idling
+        }
+        QList<RpcExecutorItem> &items = klass.flows[flow];
+        if (items.isEmpty()) {
+            klass.turns.append(flow);
+        }
+        items.append(item);
+        klass.size += 1;
+        m_submitted.fetchAndAddOrdered(1);
+    }
+
+    m_pool->start(job);
+}
+
+//
+// Picks the class with the least pass (of those with tasks), advances its
+// pass by the stride of its weight, and the flow whose turn it is:
+//
+
+bool RpcExecutor::next(RpcExecutorItem *item) {
+    Q_ASSERT(item);
+    QMutexLocker locker(&m_mutex);
+
+    RpcExecutorClass *klass = NULL;
+    for (int i = 0; i < N_PRIORITIES; i++) {
+        if (m_classes[i].size > 0 && (!klass || m_classes[i].pass < klass->pass)) {
+            klass = &m_classes[i];
+        }
+    }
+    if (!klass) {
+        return false;
+    }
+    m_pass = klass->pass;
+    klass->pass += RPC_EXECUTOR_STRIDE / klass->weight;
+
+    quint64 flow = klass->turns.takeFirst();
+    QHash<quint64, QList<RpcExecutorItem> >::iterator it = klass->flows.find(flow);
+    Q_ASSERT(it != klass->flows.end());
+    *item = it.value().takeFirst();
+    if (it.value().isEmpty()) {
+        klass->flows.erase(it);
+    } else {
+        klass->turns.append(flow);
+    }
+    klass->size -= 1;
+
+    if (item->token) {
+        item->token->m_state.storeRelease(RpcToken::Running);
+    }
+    return true;
+}
+
+//
+// Cancels a task: A queued one is removed (counting as started and
+// completed), whereupon one of the pool's jobs finds nothing to run.
+//
+
+bool RpcExecutor::cancel(const QSharedPointer<RpcToken> &token) {
+    Q_ASSERT(token);
+    token->m_cancelled.storeRelease(1);
+
+    QRunnable *task = remove(token);
+    if (task && task->autoDelete()) {
+        delete task;
+    }
+    return task != NULL;
+}
+
+//
+// Takes a queued task back (without flagging it), for the caller to run it
+// inline or to delete it, like QThreadPool::tryTake.
+//
+
+bool RpcExecutor::take(const QSharedPointer<RpcToken> &token) {
+    Q_ASSERT(token);
+    return remove(token) != NULL;
+}
+
+QRunnable *RpcExecutor::remove(const QSharedPointer<RpcToken> &token) {
+    QRunnable *task = NULL;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (token->m_state.loadAcquire() != RpcToken::Queued) {
+            return NULL; // running or done
+        }
+        RpcExecutorClass &klass = m_classes[token->m_priority];
+        QHash<quint64, QList<RpcExecutorItem> >::iterator it = klass.flows.find(token->m_flow);
+        Q_ASSERT(it != klass.flows.end());
+        QList<RpcExecutorItem> &items = it.value();
+        for (int i = 0; i < items.size(); i++) {
+            if (items[i].token == token) {
+                task = items.takeAt(i).task;
+                break;
+            }
+        }
+        Q_ASSERT(task);
+        if (items.isEmpty()) {
+            klass.flows.erase(it);
+            klass.turns.removeOne(token->m_flow);
+        }
+        klass.size -= 1;
+        token->m_state.storeRelease(RpcToken::Cancelled);
+    }
+    m_started.fetchAndAddOrdered(1);
+    m_completed.fetchAndAddOrdered(1);
+    return task;
+}
+
+void RpcExecutor::onStart(qint64 stamp) {
+    m_started.fetchAndAddOrdered(1);
+    if (m_alert_ms <= 0) {
+        return;
+    }
+
+    qint64 now = RpcMetrics::now();
+    qint64 wait_ms = (now - stamp) / 1000000;
+    if (wait_ms < m_alert_ms) {
+        return;
+    }
+
+    //
+    // At most one alert per second is logged, but every one is signalled:
+    //
+
+    qint64 alerted = m_alerted.load();
+    if (now - alerted >= 1000000000 && m_alerted.testAndSetOrdered(alerted, now)) {
+        qWarning() << "[on:saturated]" << "wait:" << wait_ms << "ms"
+                   << "queued:" << queued() << "active:" << active();
+    }
+    emit saturated(wait_ms, queued(), active());
+}
+
+void RpcExecutor::onDone() {
+    m_completed.fetchAndAddOrdered(1);
+}
+
+int RpcExecutor::threads() const {
+    return m_pool->maxThreadCount();
+}
+
+int RpcExecutor::active() const {
+    quint64 completed = m_completed.load();
+    quint64 started = m_started.load();
+    return int(started > completed ? started - completed : 0);
+}
+
+int RpcExecutor::queued() const {
+    quint64 started = m_started.load();
+    quint64 submitted = m_submitted.loadAcquire();
+    return int(submitted > started ? submitted - started : 0);
+}
+
+//
+// Each flow is FIFO, hence the oldest queued task is at the head of one:
+//
+
+qint64 RpcExecutor::oldest() const {
+    qint64 queued = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (int i = 0; i < N_PRIORITIES; i++) {
+            QHash<quint64, QList<RpcExecutorItem> >::const_iterator it;
+            for (it = m_classes[i].flows.constBegin(); it != m_classes[i].flows.constEnd(); ++it) {
+                qint64 head = it.value().first().queued;
+                queued = queued ? qMin(queued, head) : head;
+            }
+        }
+    }
+    return queued ? RpcMetrics::now() - queued : 0;
+}
+
+void RpcExecutor::onSample() {
+    qint64 now = RpcMetrics::now();
+    qint64 elapsed = now - m_sampled_at;
+
+    m_lag = qMax(elapsed - qint64(RPC_EXECUTOR_SAMPLE_MS) * 1000000, qint64(0));
+
+    quint64 completed = m_completed.load();
+    m_throughput = elapsed > 0 ? (completed - m_sampled) * 1e9 / elapsed : 0.0;
+    m_sampled = completed;
+    m_sampled_at = now;
+}
+
+QByteArray RpcExecutor::prometheus() const {
+    QByteArray text;
+    text.append("# HELP rpc_executor_threads Maximum number of worker threads.\n");
+    text.append("# TYPE rpc_executor_threads gauge\n");
+    text.append("rpc_executor_threads ")
+            .append(QByteArray::number(threads())).append('\n');
+    text.append("# HELP rpc_executor_active Tasks running on a worker.\n");
+    text.append("# TYPE rpc_executor_active gauge\n");
+    text.append("rpc_executor_active ")
+            .append(QByteArray::number(active())).append('\n');
+    text.append("# HELP rpc_executor_queued Tasks waiting for a worker.\n");
+    text.append("# TYPE rpc_executor_queued gauge\n");
+    text.append("rpc_executor_queued ")
+            .append(QByteArray::number(queued())).append('\n');
+    text.append("# HELP rpc_executor_queued_by_priority Tasks waiting for a worker per priority class.\n");
+    text.append("# TYPE rpc_executor_queued_by_priority gauge\n");
+    for (int i = 0; i < N_PRIORITIES; i++) {
+        int size;
+        {
+            QMutexLocker locker(&m_mutex);
+            size = m_classes[i].size;
+        }
+        text.append("rpc_executor_queued_by_priority{priority=\"").append(PRIORITY_NAMES[i])
+                .append("\"} ").append(QByteArray::number(size)).append('\n');
+    }
+    text.append("# HELP rpc_executor_oldest_microseconds Age of the oldest waiting task.\n");
+    text.append("# TYPE rpc_executor_oldest_microseconds gauge\n");
+    text.append("rpc_executor_oldest_microseconds ")
+            .append(QByteArray::number(oldest() / 1000)).append('\n');
+    text.append("# HELP rpc_executor_completed_total Tasks completed.\n");
+    text.append("# TYPE rpc_executor_completed_total counter\n");
+    text.append("rpc_executor_completed_total ")
+            .append(QByteArray::number(completed())).append('\n');
+    text.append("# HELP rpc_executor_throughput Tasks completed per second (last second).\n");
+    text.append("# TYPE rpc_executor_throughput gauge\n");
+    text.append("rpc_executor_throughput ")
+            .append(QByteArray::number(m_throughput, 'f', 1)).append('\n');
+    text.append("# HELP rpc_io_lag_microseconds Delay of the I/O thread's event loop.\n");
+    text.append("# TYPE rpc_io_lag_microseconds gauge\n");
+    text.append("rpc_io_lag_microseconds ")
+            .append(QByteArray::number(m_lag / 1000)).append('\n');
+    return text;
+}
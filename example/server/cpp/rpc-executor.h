@@ -0,0 +1,136 @@
+#ifndef RPC_EXECUTOR_H
+#define RPC_EXECUTOR_H
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QSharedPointer>
+
+QT_FORWARD_DECLARE_CLASS(QRunnable)
+QT_FORWARD_DECLARE_CLASS(QThreadPool)
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+class RpcExecutorJob;
+struct RpcExecutorItem;
+struct RpcExecutorClass;
+
+//
+// Cancellation token of a task: A task cancelled (or taken back) while
+// queued is removed from the executor's queue, while a running one merely
+// gets its flag set, for its handler to poll. The state changes from queued
+// under the executor's lock only, such that a task is either dequeued or
+// removed.
+//
+
+class RpcToken
+{
+public:
+    enum State { Queued, Running, Done, Cancelled };
+
+    RpcToken() : m_state(Queued), m_cancelled(0), m_priority(0), m_flow(0) {}
+
+    bool cancelled() const { return m_cancelled.loadAcquire() != 0; }
+    int priority() const { return m_priority; } // RpcExecutor::Priority
+    quint64 flow() const { return m_flow; }
+    bool finished() const {
+        int state = m_state.loadAcquire();
+        return state == Done || state == Cancelled;
+    }
+
+private:
+    friend class RpcExecutor;
+    friend class RpcExecutorJob;
+    QAtomicInt m_state;
+    QAtomicInt m_cancelled;
+    int m_priority;
+    quint64 m_flow;
+};
+
+//
+// Front of a thread pool which schedules the tasks itself and keeps gauges
+// of the pool: the running and queued tasks, the age of the oldest queued
+// one, the throughput and the lag of the thread owning the executor (i.e.
+// the I/O thread). A growing queue with a small lag means saturated workers,
+// a large lag a saturated I/O thread.
+//
+// Tasks are queued per priority class and per flow (i.e. connection), and
+// the pool is handed an interchangeable job per task, which dequeues the
+// next task once a worker picks it up: The classes share the workers by
+// weight (stride scheduling, where an idle class gets no credit), and the
+// flows of a class take turns. Hence health checks and interactive calls
+// overtake the bulk traffic saturating the workers, and no connection can
+// starve the others of its class.
+//
+
+class RpcExecutor : public QObject
+{
+    Q_OBJECT
+public:
+    enum Priority { High, Normal, Low };
+    static const int N_PRIORITIES = 3;
+
+    explicit RpcExecutor(QThreadPool *pool, QObject *parent = 0);
+    ~RpcExecutor();
+
+Q_SIGNALS:
+    void saturated(qint64 wait_ms, int queued, int active);
+
+public:
+    void start(QRunnable *task, const QSharedPointer<RpcToken> &token = QSharedPointer<RpcToken>(),
+               Priority priority = Normal, quint64 flow = 0);
+    bool cancel(const QSharedPointer<RpcToken> &token);
+    bool take(const QSharedPointer<RpcToken> &token);
+
+    Priority priority(const QByteArray &method, quint32 requested = 0) const;
+    void setPriority(const QByteArray &method, Priority priority);
+    static bool parsePriority(const QString &name, Priority *priority);
+
+    int getWeight(Priority priority) const;
+    void setWeight(Priority priority, int weight);
+
+    int threads() const;
+    int active() const;
+    int queued() const;
+    qint64 oldest() const; // [ns]
+    quint64 completed() const { return m_completed.load(); }
+    double throughput() const { return m_throughput; } // [tasks/s]
+    qint64 lag() const { return m_lag; } // [ns]
+
+    QByteArray prometheus() const;
+
+private Q_SLOTS:
+    void onSample();
+
+private:
+    friend class RpcExecutorJob;
+    bool next(RpcExecutorItem *item);
+    QRunnable *remove(const QSharedPointer<RpcToken> &token);
+    void onStart(qint64 stamp);
+    void onDone();
+
+private:
+    QThreadPool *m_pool;
+    QTimer *m_timer;
+    mutable QMutex m_mutex;
+    RpcExecutorClass *m_classes; // [N_PRIORITIES]
+    quint64 m_pass;
+    QHash<QByteArray, Priority> m_priorities;
+    QAtomicInteger<quint64> m_submitted;
+    QAtomicInteger<quint64> m_started;
+    QAtomicInteger<quint64> m_completed;
+    QAtomicInteger<qint64> m_alerted;
+    quint64 m_sampled;
+    qint64 m_sampled_at;
+    double m_throughput;
+    qint64 m_lag;
+
+private:
+    int m_alert_ms;
+public:
+    int getAlertMs() { return m_alert_ms; }
+    void setAlertMs(int value) { m_alert_ms = value; }
+};
+
+#endif // RPC_EXECUTOR_H
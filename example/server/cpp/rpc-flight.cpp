@@ -0,0 +1,106 @@
+#include "rpc-flight.h"
+#include "rpc-hash.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <cstring>
+
+RpcFlight::RpcFlight()
+    : m_led(0), m_boarded(0)
+{
+}
+
+RpcFlight *RpcFlight::instance() {
+    static RpcFlight *flight = new RpcFlight();
+    return flight;
+}
+
+void RpcFlight::setMethods(const QStringList &methods) {
+    m_methods.clear();
+    foreach (const QString &method, methods) {
+        QByteArray name = method.trimmed().toUtf8();
+        if (!name.isEmpty()) {
+            m_methods.insert(name, RpcHash(name.constData(), size_t(name.size())));
+        }
+    }
+}
+
+bool RpcFlight::board(const std::string &method, const std::string &data,
+                      Ticket *ticket, const Passenger &passenger) {
+    Q_ASSERT(ticket && !ticket->m_flight);
+    quint64 seed = m_methods.value(QByteArray::fromRawData(method.data(), int(method.size())));
+    quint64 hash = RpcHash(data.data(), data.size(), seed);
+
+    QMutexLocker locker(&m_mutex);
+    QSharedPointer<Flight> flight = m_flights.value(hash);
+    if (!flight) {
+        flight = QSharedPointer<Flight>(new Flight());
+        Q_ASSERT(flight);
+        flight->hash = hash;
+        flight->method = QByteArray(method.data(), int(method.size()));
+        flight->data = QByteArray(data.data(), int(data.size()));
+        m_flights.insert(hash, flight);
+        ticket->m_flight = flight;
+        m_led.fetchAndAddRelaxed(1);
+        return false;
+    }
+
+    //
+    // On a hash collision the request neither boards nor leads, i.e. it is
+    // simply computed on its own:
+    //
+
+    if (flight->method.size() != int(method.size()) ||
+            flight->data.size() != int(data.size()) ||
+            memcmp(flight->method.constData(), method.data(), method.size()) != 0 ||
+            memcmp(flight->data.constData(), data.data(), data.size()) != 0) {
+        return false;
+    }
+
+    m_boarded.fetchAndAddRelaxed(1);
+    flight->passengers.append(passenger);
+    return true;
+}
+
+//
+// Lands the flight (if led): The passengers are returned for an actual
+// response only, otherwise they are dropped, i.e. fail.
+//
+
+QList<RpcFlight::Passenger> RpcFlight::Ticket::land(const QByteArray &response) {
+    QList<Passenger> passengers;
+    if (m_flight) {
+        passengers = RpcFlight::instance()->land(m_flight);
+        m_flight.clear();
+    }
+    if (response.isEmpty()) {
+        passengers.clear();
+    }
+    return passengers;
+}
+
+QList<RpcFlight::Passenger> RpcFlight::land(const QSharedPointer<Flight> &flight) {
+    QMutexLocker locker(&m_mutex);
+    if (m_flights.value(flight->hash) == flight) {
+        m_flights.remove(flight->hash);
+    }
+    QList<Passenger> passengers;
+    passengers.swap(flight->passengers);
+    return passengers;
+}
+
+QByteArray RpcFlight::prometheus() const {
+    QByteArray text;
+    if (m_methods.isEmpty()) {
+        return text;
+    }
+    text.append("# HELP rpc_flight_led_total Requests computed for themselves and identical ones.\n");
+    text.append("# TYPE rpc_flight_led_total counter\n");
+    text.append("rpc_flight_led_total ")
+            .append(QByteArray::number(led())).append('\n');
+    text.append("# HELP rpc_flight_boarded_total Requests answered by an identical one in progress.\n");
+    text.append("# TYPE rpc_flight_boarded_total counter\n");
+    text.append("rpc_flight_boarded_total ")
+            .append(QByteArray::number(boarded())).append('\n');
+    return text;
+}
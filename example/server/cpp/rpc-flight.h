@@ -0,0 +1,89 @@
+#ifndef RPC_FLIGHT_H
+#define RPC_FLIGHT_H
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QStringList>
+
+#include "rpc-task.h"
+
+#include <string>
+
+//
+// Single flight of identical requests (of methods opted into by name): The
+// first request of a method and payload leads a flight, and an identical one
+// arriving while it is in progress boards it, i.e. leaves its client, id and
+// stamp with the flight and returns its worker to the pool at once, instead
+// of computing the response again.
+//
+// A flight lands once its leader serialized the response, or failed: Landing
+// hands the passengers to the leader, which answers each of them (with the
+// response re-stamped with their own id). A ticket lands with an empty
+// response when destroyed, i.e. upon an exception the passengers fail too.
+//
+
+class RpcFlight
+{
+    struct Flight;
+public:
+    struct Passenger {
+        quint64 client;
+        RpcStamp stamp; // with the passenger's id
+        QSharedPointer<RpcToken> token;
+    };
+
+    class Ticket
+    {
+    public:
+        Ticket() {}
+        ~Ticket() { land(QByteArray()); }
+
+        QList<Passenger> land(const QByteArray &response);
+
+    private:
+        friend class RpcFlight;
+        QSharedPointer<Flight> m_flight;
+        Q_DISABLE_COPY(Ticket)
+    };
+
+    static RpcFlight *instance();
+
+    void setMethods(const QStringList &methods);
+
+    bool coalesces(const std::string &method) const {
+        return !m_methods.isEmpty() && m_methods.contains(
+                    QByteArray::fromRawData(method.data(), int(method.size())));
+    }
+
+    bool board(const std::string &method, const std::string &data,
+               Ticket *ticket, const Passenger &passenger);
+
+    quint64 led() const { return m_led.load(); }
+    quint64 boarded() const { return m_boarded.load(); }
+    QByteArray prometheus() const;
+
+private:
+    RpcFlight();
+    QList<Passenger> land(const QSharedPointer<Flight> &flight);
+
+    struct Flight {
+        Flight() : hash(0) {}
+        quint64 hash;
+        QByteArray method;
+        QByteArray data;
+        QList<Passenger> passengers;
+    };
+
+private:
+    QHash<QByteArray, quint64> m_methods; // name => hash seed
+    QMutex m_mutex;
+    QHash<quint64, QSharedPointer<Flight> > m_flights;
+    QAtomicInteger<quint64> m_led;
+    QAtomicInteger<quint64> m_boarded;
+};
+
+#endif // RPC_FLIGHT_H
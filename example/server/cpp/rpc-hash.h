@@ -0,0 +1,49 @@
+#ifndef RPC_HASH_H
+#define RPC_HASH_H
+
+#include <QtCore/QtGlobal>
+
+#include <cstring>
+
+//
+// 64 bit hash of a byte string (MurmurHash64A): Eight bytes per step, which
+// is good enough to key caches by request payloads; a caching caller has to
+// compare the payloads on a hit anyway, since the hash is not collision free.
+//
+
+inline quint64 RpcHash(const void *data, size_t length, quint64 seed = 0) {
+    const quint64 m = Q_UINT64_C(0xc6a4a7935bd1e995);
+    const int r = 47;
+
+    const quint8 *bytes = static_cast<const quint8*>(data);
+    quint64 hash = seed ^ (length * m);
+
+    for (size_t i = 0; i + 8 <= length; i += 8) {
+        quint64 k;
+        memcpy(&k, bytes + i, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        hash ^= k;
+        hash *= m;
+    }
+
+    const quint8 *tail = bytes + (length & ~size_t(7));
+    switch (length & 7) {
+    case 7: hash ^= quint64(tail[6]) << 48; // fall through
+    case 6: hash ^= quint64(tail[5]) << 40; // fall through
+    case 5: hash ^= quint64(tail[4]) << 32; // fall through
+    case 4: hash ^= quint64(tail[3]) << 24; // fall through
+    case 3: hash ^= quint64(tail[2]) << 16; // fall through
+    case 2: hash ^= quint64(tail[1]) << 8; // fall through
+    case 1: hash ^= quint64(tail[0]);
+        hash *= m;
+    }
+
+    hash ^= hash >> r;
+    hash *= m;
+    hash ^= hash >> r;
+    return hash;
+}
+
+#endif // RPC_HASH_H
@@ -0,0 +1,104 @@
+#include "rpc-histogram.h"
+
+#define RPC_HISTOGRAM_LINEAR 128
+#define RPC_HISTOGRAM_SUB_BITS 6
+#define RPC_HISTOGRAM_SIZE (RPC_HISTOGRAM_LINEAR + (64 - 7) * (1 << RPC_HISTOGRAM_SUB_BITS))
+
+RpcHistogram::RpcHistogram()
+    : m_counts(RPC_HISTOGRAM_SIZE, 0), m_count(0), m_min(0), m_max(0), m_sum(0) {
+}
+
+int RpcHistogram::index(quint64 value) {
+    if (value < RPC_HISTOGRAM_LINEAR) {
+        return int(value);
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - RPC_HISTOGRAM_SUB_BITS;
+    int sub = int(value >> shift) - (1 << RPC_HISTOGRAM_SUB_BITS);
+    Q_ASSERT(sub >= 0 && sub < (1 << RPC_HISTOGRAM_SUB_BITS));
+
+    return RPC_HISTOGRAM_LINEAR + (msb - 7) * (1 << RPC_HISTOGRAM_SUB_BITS) + sub;
+}
+
+quint64 RpcHistogram::highest(int index) {
+    if (index < RPC_HISTOGRAM_LINEAR) {
+        return quint64(index);
+    }
+
+    int octave = (index - RPC_HISTOGRAM_LINEAR) >> RPC_HISTOGRAM_SUB_BITS;
+    int sub = (index - RPC_HISTOGRAM_LINEAR) & ((1 << RPC_HISTOGRAM_SUB_BITS) - 1);
+    int shift = octave + 7 - RPC_HISTOGRAM_SUB_BITS;
+
+    quint64 lowest = quint64((1 << RPC_HISTOGRAM_SUB_BITS) + sub) << shift;
+    return lowest + ((quint64(1) << shift) - 1);
+}
+
+void RpcHistogram::record(quint64 value, quint64 count) {
+    if (count == 0) {
+        return;
+    }
+
+    m_counts[index(value)] += count;
+    if (m_count == 0 || value < m_min) {
+        m_min = value;
+    }
+    if (value > m_max) {
+        m_max = value;
+    }
+    m_count += count;
+    m_sum += value * count;
+}
+
+void RpcHistogram::add(const RpcHistogram &other) {
+    if (other.m_count == 0) {
+        return;
+    }
+
+    for (int i = 0; i < m_counts.size(); i++) {
+        m_counts[i] += other.m_counts[i];
+    }
+    if (m_count == 0 || other.m_min < m_min) {
+        m_min = other.m_min;
+    }
+    if (other.m_max > m_max) {
+        m_max = other.m_max;
+    }
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+}
+
+void RpcHistogram::reset() {
+    m_counts.fill(0);
+    m_count = m_min = m_max = m_sum = 0;
+}
+
+quint64 RpcHistogram::percentile(double percent) const {
+    if (m_count == 0) {
+        return 0;
+    }
+
+    quint64 rank = quint64(percent / 100.0 * m_count + 0.5);
+    rank = qBound(quint64(1), rank, m_count);
+
+    quint64 total = 0;
+    for (int i = 0; i < m_counts.size(); i++) {
+        total += m_counts[i];
+        if (total >= rank) {
+            return qBound(m_min, highest(i), m_max);
+        }
+    }
+    return m_max;
+}
+
+quint64 RpcHistogram::countBelow(quint64 value) const {
+    if (value >= m_max) {
+        return m_count;
+    }
+
+    quint64 total = 0;
+    for (int i = 0; i < m_counts.size() && highest(i) <= value; i++) {
+        total += m_counts[i];
+    }
+    return total;
+}
@@ -0,0 +1,42 @@
+#ifndef RPC_HISTOGRAM_H
+#define RPC_HISTOGRAM_H
+
+#include <QtCore/QVector>
+
+//
+// HDR style histogram with log-linear buckets: Values below 128 are counted
+// exactly, above each power of two is split into 64 buckets, which bounds the
+// relative error of a reported value by 1/64 (~1.6%) across the full range.
+//
+
+class RpcHistogram
+{
+public:
+    RpcHistogram();
+
+    void record(quint64 value, quint64 count = 1);
+    void add(const RpcHistogram &other);
+    void reset();
+
+    quint64 count() const { return m_count; }
+    quint64 min() const { return m_count ? m_min : 0; }
+    quint64 max() const { return m_max; }
+    quint64 sum() const { return m_sum; }
+    double mean() const { return m_count ? double(m_sum) / m_count : 0.0; }
+
+    quint64 percentile(double percent) const;
+    quint64 countBelow(quint64 value) const;
+
+private:
+    static int index(quint64 value);
+    static quint64 highest(int index);
+
+private:
+    QVector<quint64> m_counts;
+    quint64 m_count;
+    quint64 m_min;
+    quint64 m_max;
+    quint64 m_sum;
+};
+
+#endif // RPC_HISTOGRAM_H
@@ -0,0 +1,156 @@
+#include "rpc-log.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThreadStorage>
+
+#include <cstring>
+
+#define RPC_LOG_RING (1 << 20)
+
+namespace {
+    struct RpcLogHeader {
+        const char *tag;
+        quint32 length;
+    };
+
+    struct RpcLogRing {
+        RpcLogRing() : buffer(new char[RPC_LOG_RING]), head(0), tail(0), dropped(0), seen(0) {}
+        char *buffer;
+        QAtomicInteger<quint64> head;
+        QAtomicInteger<quint64> tail;
+        QAtomicInteger<quint64> dropped;
+        quint64 seen;
+
+        void put(quint64 at, const char *data, quint64 size) {
+            quint64 offset = at & (RPC_LOG_RING - 1);
+            quint64 first = qMin(size, RPC_LOG_RING - offset);
+            memcpy(buffer + offset, data, first);
+            memcpy(buffer, data + first, size - first);
+        }
+        void get(quint64 at, char *data, quint64 size) const {
+            quint64 offset = at & (RPC_LOG_RING - 1);
+            quint64 first = qMin(size, RPC_LOG_RING - offset);
+            memcpy(data, buffer + offset, first);
+            memcpy(data + first, buffer, size - first);
+        }
+    };
+
+    //
+    // Like the trace rings, a ring of a finished thread is handed on to the
+    // next new one; records still pending in it are drained as usual.
+    //
+
+    QMutex g_mutex;
+    QList<RpcLogRing*> g_rings;
+    QList<RpcLogRing*> g_free;
+
+    struct RpcLogHolder {
+        RpcLogHolder(RpcLogRing *ring) : ring(ring) {}
+        ~RpcLogHolder() {
+            QMutexLocker locker(&g_mutex);
+            g_free << ring;
+        }
+        RpcLogRing *ring;
+    };
+
+    QThreadStorage<RpcLogHolder*> g_holders;
+
+    RpcLogRing *local() {
+        if (!g_holders.hasLocalData()) {
+            QMutexLocker locker(&g_mutex);
+            RpcLogRing *ring = g_free.isEmpty() ? NULL : g_free.takeLast();
+            if (ring == NULL) {
+                ring = new RpcLogRing();
+                Q_ASSERT(ring);
+                g_rings << ring;
+            }
+            g_holders.setLocalData(new RpcLogHolder(ring));
+        }
+        return g_holders.localData()->ring;
+    }
+}
+
+RpcLog::RpcLog(QObject *parent)
+    : QThread(parent), m_stop(0), m_sample(1) {
+}
+
+RpcLog *RpcLog::instance() {
+    static RpcLog *log = new RpcLog();
+    return log;
+}
+
+void RpcLog::log(const char *tag, const QByteArray &bytes) {
+    RpcLogRing *ring = local();
+    if (ring->seen++ % quint64(m_sample) != 0) {
+        return;
+    }
+
+    RpcLogHeader header;
+    header.tag = tag;
+    header.length = quint32(bytes.length());
+
+    quint64 size = sizeof(header) + header.length;
+    quint64 head = ring->head.load();
+    if (head + size - ring->tail.loadAcquire() > RPC_LOG_RING) {
+        ring->dropped.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    ring->put(head, (const char*)&header, sizeof(header));
+    ring->put(head + sizeof(header), bytes.constData(), header.length);
+    ring->head.storeRelease(head + size);
+}
+
+void RpcLog::stop() {
+    if (isRunning()) {
+        m_stop.storeRelease(1);
+        wait();
+    }
+}
+
+void RpcLog::run() {
+    while (true) {
+        bool stopping = m_stop.loadAcquire();
+        if (!drain()) {
+            if (stopping) {
+                break;
+            }
+            QThread::msleep(10);
+        }
+    }
+}
+
+bool RpcLog::drain() {
+    QList<RpcLogRing*> rings;
+    {
+        QMutexLocker locker(&g_mutex);
+        rings = g_rings;
+    }
+
+    bool drained = false;
+    foreach(RpcLogRing *ring, rings) {
+        quint64 tail = ring->tail.load();
+        quint64 head = ring->head.loadAcquire();
+
+        while (tail < head) {
+            RpcLogHeader header;
+            ring->get(tail, (char*)&header, sizeof(header));
+            QByteArray bytes(int(header.length), Qt::Uninitialized);
+            ring->get(tail + sizeof(header), bytes.data(), header.length);
+            tail += sizeof(header) + header.length;
+
+            qDebug() << header.tag << bytes;
+            drained = true;
+        }
+        ring->tail.storeRelease(tail);
+
+        quint64 dropped = ring->dropped.fetchAndStoreRelaxed(0);
+        if (dropped > 0) {
+            qDebug() << "[log:dropped]" << dropped;
+        }
+    }
+    return drained;
+}
@@ -0,0 +1,40 @@
+#ifndef RPC_LOG_H
+#define RPC_LOG_H
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QByteArray>
+#include <QtCore/QThread>
+
+//
+// Asynchronous logger: `log` only copies the raw record into a ring of the
+// calling thread (single producer, no locks) and returns; the formatting and
+// writing happens on the logger's own thread. If a ring is full the record
+// is dropped (and counted) instead of blocking the caller. With a sample of
+// N only every N-th record per thread is kept.
+//
+
+class RpcLog : public QThread
+{
+    Q_OBJECT
+public:
+    static RpcLog *instance();
+
+    void log(const char *tag, const QByteArray &bytes);
+    void stop();
+
+protected:
+    void run();
+
+private:
+    explicit RpcLog(QObject *parent = 0);
+    bool drain();
+
+private:
+    QAtomicInteger<int> m_stop;
+    int m_sample;
+public:
+    int getSample() { return m_sample; }
+    void setSample(int value) { Q_ASSERT(value > 0); m_sample = value; }
+};
+
+#endif // RPC_LOG_H
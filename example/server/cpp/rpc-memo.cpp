@@ -0,0 +1,130 @@
+#include "rpc-memo.h"
+#include "rpc-hash.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <cstring>
+
+#define RPC_MEMO_SHARDS 16
+#define RPC_MEMO_CAPACITY 65536
+#define RPC_MEMO_MAX_SIZE 4096 // payload and response [bytes]
+
+RpcMemo::RpcMemo()
+    : m_capacity(RPC_MEMO_CAPACITY / RPC_MEMO_SHARDS), m_hits(0), m_misses(0)
+{
+    for (int i = 0; i < RPC_MEMO_SHARDS; i++) {
+        m_shards.append(new Shard());
+    }
+}
+
+RpcMemo *RpcMemo::instance() {
+    static RpcMemo *memo = new RpcMemo();
+    return memo;
+}
+
+void RpcMemo::setMethods(const QStringList &methods) {
+    m_methods.clear();
+    foreach (const QString &method, methods) {
+        QByteArray name = method.trimmed().toUtf8();
+        if (!name.isEmpty()) {
+            m_methods.insert(name, RpcHash(name.constData(), size_t(name.size())));
+        }
+    }
+}
+
+void RpcMemo::setCapacity(int entries) {
+    Q_ASSERT(entries >= 0);
+    m_capacity = qMax(entries / RPC_MEMO_SHARDS, 1);
+}
+
+quint64 RpcMemo::hash(const std::string &method, const std::string &data) const {
+    quint64 seed = m_methods.value(QByteArray::fromRawData(method.data(), int(method.size())));
+    return RpcHash(data.data(), data.size(), seed);
+}
+
+RpcMemo::Shard *RpcMemo::shard(quint64 hash) {
+    return m_shards[int(hash >> 60) % RPC_MEMO_SHARDS];
+}
+
+QByteArray RpcMemo::lookup(const std::string &method, const std::string &data) {
+    quint64 hash = this->hash(method, data);
+    Shard *shard = this->shard(hash);
+
+    QMutexLocker locker(&shard->mutex);
+    int slot = shard->index.value(hash, -1);
+    if (slot >= 0) {
+        Entry &entry = shard->entries[slot];
+        if (entry.method.size() == int(method.size()) &&
+                entry.data.size() == int(data.size()) &&
+                memcmp(entry.method.constData(), method.data(), method.size()) == 0 &&
+                memcmp(entry.data.constData(), data.data(), data.size()) == 0) {
+            entry.referenced = true;
+            m_hits.fetchAndAddRelaxed(1);
+            return entry.response;
+        }
+    }
+    m_misses.fetchAndAddRelaxed(1);
+    return QByteArray();
+}
+
+void RpcMemo::insert(const std::string &method, const std::string &data, const QByteArray &response) {
+    if (data.size() + size_t(response.size()) > RPC_MEMO_MAX_SIZE) {
+        return;
+    }
+    if (response.isEmpty()) {
+        return;
+    }
+
+    Entry entry;
+    entry.hash = this->hash(method, data);
+    entry.referenced = false;
+    entry.method = QByteArray(method.data(), int(method.size()));
+    entry.data = QByteArray(data.data(), int(data.size()));
+    entry.response = response;
+
+    Shard *shard = this->shard(entry.hash);
+    QMutexLocker locker(&shard->mutex);
+
+    int slot = shard->index.value(entry.hash, -1);
+    if (slot >= 0) {
+        shard->entries[slot] = entry;
+        return;
+    }
+    if (shard->entries.size() < m_capacity) {
+        shard->index.insert(entry.hash, shard->entries.size());
+        shard->entries.append(entry);
+        return;
+    }
+
+    //
+    // CLOCK: Sweep past the referenced entries (clearing their bits) to the
+    // first unreferenced one, which is evicted; at most one full turn.
+    //
+
+    int size = shard->entries.size();
+    while (shard->entries[shard->hand].referenced) {
+        shard->entries[shard->hand].referenced = false;
+        shard->hand = (shard->hand + 1) % size;
+    }
+    Entry &victim = shard->entries[shard->hand];
+    shard->index.remove(victim.hash);
+    shard->index.insert(entry.hash, shard->hand);
+    victim = entry;
+    shard->hand = (shard->hand + 1) % size;
+}
+
+QByteArray RpcMemo::prometheus() const {
+    QByteArray text;
+    if (m_methods.isEmpty()) {
+        return text;
+    }
+    text.append("# HELP rpc_memo_hits_total Requests answered from the result cache.\n");
+    text.append("# TYPE rpc_memo_hits_total counter\n");
+    text.append("rpc_memo_hits_total ")
+            .append(QByteArray::number(hits())).append('\n');
+    text.append("# HELP rpc_memo_misses_total Requests of memoized methods not in the result cache.\n");
+    text.append("# TYPE rpc_memo_misses_total counter\n");
+    text.append("rpc_memo_misses_total ")
+            .append(QByteArray::number(misses())).append('\n');
+    return text;
+}
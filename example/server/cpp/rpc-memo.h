@@ -0,0 +1,74 @@
+#ifndef RPC_MEMO_H
+#define RPC_MEMO_H
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+#include <string>
+
+//
+// Result cache of pure methods (opted into by name): Responses are keyed by
+// the method and a 64 bit hash of the request payload, and a hit returns the
+// serialized response (shared, for the caller to re-stamp its id), i.e. skips
+// parsing, computing and serializing entirely.
+//
+// The cache is split into shards of an own mutex each (picked by the hash),
+// which are evicted with the CLOCK algorithm: An entry's reference bit is set
+// on a hit and cleared by the passing hand, which evicts the first entry it
+// finds unreferenced. A hit costs a lock, a hash lookup and a comparison of
+// the payloads (to rule out collisions) but no allocation.
+//
+
+class RpcMemo
+{
+public:
+    static RpcMemo *instance();
+
+    void setMethods(const QStringList &methods);
+    void setCapacity(int entries);
+
+    bool memoizes(const std::string &method) const {
+        return !m_methods.isEmpty() && m_methods.contains(
+                    QByteArray::fromRawData(method.data(), int(method.size())));
+    }
+
+    QByteArray lookup(const std::string &method, const std::string &data);
+    void insert(const std::string &method, const std::string &data, const QByteArray &response);
+
+    quint64 hits() const { return m_hits.load(); }
+    quint64 misses() const { return m_misses.load(); }
+    QByteArray prometheus() const;
+
+private:
+    RpcMemo();
+    quint64 hash(const std::string &method, const std::string &data) const;
+
+    struct Entry {
+        quint64 hash;
+        bool referenced;
+        QByteArray method;
+        QByteArray data;
+        QByteArray response;
+    };
+    struct Shard {
+        Shard() : hand(0) {}
+        QMutex mutex;
+        QHash<quint64, int> index;
+        QVector<Entry> entries;
+        int hand;
+    };
+    Shard *shard(quint64 hash);
+
+private:
+    QHash<QByteArray, quint64> m_methods; // name => hash seed
+    QVector<Shard*> m_shards;
+    int m_capacity; // per shard
+    QAtomicInteger<quint64> m_hits;
+    QAtomicInteger<quint64> m_misses;
+};
+
+#endif // RPC_MEMO_H
@@ -0,0 +1,215 @@
+#include "rpc-metrics.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThreadStorage>
+
+bool RpcMetrics::s_enabled = false;
+
+namespace {
+    struct RpcMetricsHolder {
+        RpcMetricsHolder(RpcMetrics::Shard *shard) : shard(shard) {}
+        ~RpcMetricsHolder() { RpcMetrics::instance()->retire(shard); }
+        RpcMetrics::Shard *shard;
+    };
+
+    QThreadStorage<RpcMetricsHolder*> g_shards;
+
+    const quint64 SIZE_BUCKETS[] = {
+        64, 256, 1024, 4096, 16384, 65536, 262144, 1048576
+    };
+    const quint64 TIME_BUCKETS[] = {
+        10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000,
+        25000, 50000, 100000, 250000, 500000, 1000000
+    };
+
+    void putHistogram(QByteArray &text, const char *name, const char *help,
+                      const QHash<QByteArray, RpcMethodMetrics> &methods,
+                      RpcHistogram RpcMethodMetrics::*member,
+                      const quint64 *buckets, int n_buckets) {
+        text.append("# HELP ").append(name).append(' ').append(help).append('\n');
+        text.append("# TYPE ").append(name).append(" histogram\n");
+
+        QHash<QByteArray, RpcMethodMetrics>::const_iterator it;
+        for (it = methods.constBegin(); it != methods.constEnd(); ++it) {
+            const RpcHistogram &histogram = it.value().*member;
+            QByteArray label = QByteArray("method=\"").append(it.key()).append('"');
+            for (int i = 0; i < n_buckets; i++) {
+                text.append(name).append("_bucket{").append(label)
+                        .append(",le=\"").append(QByteArray::number(buckets[i])).append("\"} ")
+                        .append(QByteArray::number(histogram.countBelow(buckets[i]))).append('\n');
+            }
+            text.append(name).append("_bucket{").append(label).append(",le=\"+Inf\"} ")
+                    .append(QByteArray::number(histogram.count())).append('\n');
+            text.append(name).append("_sum{").append(label).append("} ")
+                    .append(QByteArray::number(histogram.sum())).append('\n');
+            text.append(name).append("_count{").append(label).append("} ")
+                    .append(QByteArray::number(histogram.count())).append('\n');
+        }
+    }
+
+    void putCounter(QByteArray &text, const char *name, const char *help,
+                    const QHash<QByteArray, RpcMethodMetrics> &methods,
+                    quint64 RpcMethodMetrics::*member) {
+        text.append("# HELP ").append(name).append(' ').append(help).append('\n');
+        text.append("# TYPE ").append(name).append(" counter\n");
+
+        QHash<QByteArray, RpcMethodMetrics>::const_iterator it;
+        for (it = methods.constBegin(); it != methods.constEnd(); ++it) {
+            text.append(name).append("{method=\"").append(it.key()).append("\"} ")
+                    .append(QByteArray::number(it.value().*member)).append('\n');
+        }
+    }
+
+    void putPerf(QByteArray &text, const char *name, const char *help,
+                 const QHash<QByteArray, RpcMethodMetrics> &methods,
+                 quint64 RpcPerfSample::*member) {
+        text.append("# HELP ").append(name).append(' ').append(help).append('\n');
+        text.append("# TYPE ").append(name).append(" counter\n");
+
+        QHash<QByteArray, RpcMethodMetrics>::const_iterator it;
+        for (it = methods.constBegin(); it != methods.constEnd(); ++it) {
+            if (it.value().sampled == 0) {
+                continue;
+            }
+            text.append(name).append("{method=\"").append(it.key()).append("\"} ")
+                    .append(QByteArray::number(it.value().perf.*member)).append('\n');
+        }
+    }
+}
+
+RpcMetrics::RpcMetrics() {
+}
+
+RpcMetrics *RpcMetrics::instance() {
+    static RpcMetrics *metrics = new RpcMetrics();
+    return metrics;
+}
+
+qint64 RpcMetrics::now() {
+    static QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed();
+}
+
+RpcMetrics::Shard *RpcMetrics::shard() {
+    if (!g_shards.hasLocalData()) {
+        Shard *shard = new Shard();
+        Q_ASSERT(shard);
+        {
+            QMutexLocker locker(&m_mutex);
+            m_shards << shard;
+        }
+        g_shards.setLocalData(new RpcMetricsHolder(shard));
+    }
+    return g_shards.localData()->shard;
+}
+
+void RpcMetrics::retire(Shard *shard) {
+    QMutexLocker locker(&m_mutex);
+    bool removed = m_shards.removeOne(shard);
+    Q_ASSERT(removed);
+
+    merge(m_retired, shard->methods);
+    delete shard;
+}
+
+void RpcMetrics::record(const QByteArray &method, quint64 size, qint64 wait, qint64 exec, bool error) {
+    Shard *shard = this->shard();
+    QMutexLocker locker(&shard->mutex);
+
+    RpcMethodMetrics &metrics = shard->methods[method];
+    metrics.requests += 1;
+    if (error) {
+        metrics.errors += 1;
+    }
+    metrics.size.record(size);
+    metrics.wait.record(quint64(qMax(wait, qint64(0)) / 1000));
+    metrics.exec.record(quint64(qMax(exec, qint64(0)) / 1000));
+}
+
+void RpcMetrics::recordTotal(const QByteArray &method, qint64 total) {
+    Shard *shard = this->shard();
+    QMutexLocker locker(&shard->mutex);
+
+    RpcMethodMetrics &metrics = shard->methods[method];
+    metrics.total.record(quint64(qMax(total, qint64(0)) / 1000));
+}
+
+void RpcMetrics::recordPerf(const QByteArray &method, const RpcPerfSample &sample) {
+    Shard *shard = this->shard();
+    QMutexLocker locker(&shard->mutex);
+
+    RpcMethodMetrics &metrics = shard->methods[method];
+    metrics.sampled += 1;
+    metrics.perf += sample;
+}
+
+void RpcMetrics::merge(QHash<QByteArray, RpcMethodMetrics> &lhs,
+                       const QHash<QByteArray, RpcMethodMetrics> &rhs) {
+    QHash<QByteArray, RpcMethodMetrics>::const_iterator it;
+    for (it = rhs.constBegin(); it != rhs.constEnd(); ++it) {
+        RpcMethodMetrics &metrics = lhs[it.key()];
+        metrics.requests += it.value().requests;
+        metrics.errors += it.value().errors;
+        metrics.sampled += it.value().sampled;
+        metrics.perf += it.value().perf;
+        metrics.size.add(it.value().size);
+        metrics.wait.add(it.value().wait);
+        metrics.exec.add(it.value().exec);
+        metrics.total.add(it.value().total);
+    }
+}
+
+QHash<QByteArray, RpcMethodMetrics> RpcMetrics::snapshot() const {
+    QMutexLocker locker(&m_mutex);
+    QHash<QByteArray, RpcMethodMetrics> methods = m_retired;
+
+    foreach(Shard *shard, m_shards) {
+        QMutexLocker shard_locker(&shard->mutex);
+        merge(methods, shard->methods);
+    }
+    return methods;
+}
+
+QByteArray RpcMetrics::prometheus() const {
+    QHash<QByteArray, RpcMethodMetrics> methods = snapshot();
+    int n_sizes = int(sizeof(SIZE_BUCKETS) / sizeof(SIZE_BUCKETS[0]));
+    int n_times = int(sizeof(TIME_BUCKETS) / sizeof(TIME_BUCKETS[0]));
+
+    QByteArray text;
+    putCounter(text, "rpc_requests_total",
+               "Requests processed per method.", methods, &RpcMethodMetrics::requests);
+    putCounter(text, "rpc_errors_total",
+               "Requests failed per method.", methods, &RpcMethodMetrics::errors);
+    putHistogram(text, "rpc_request_bytes",
+                 "Request envelope sizes per method.", methods,
+                 &RpcMethodMetrics::size, SIZE_BUCKETS, n_sizes);
+    putHistogram(text, "rpc_queue_wait_microseconds",
+                 "Time between queueing and a worker starting a request.", methods,
+                 &RpcMethodMetrics::wait, TIME_BUCKETS, n_times);
+    putHistogram(text, "rpc_exec_microseconds",
+                 "Time spent processing a request on a worker.", methods,
+                 &RpcMethodMetrics::exec, TIME_BUCKETS, n_times);
+    putHistogram(text, "rpc_total_microseconds",
+                 "Time between queueing and the result reaching the I/O thread.", methods,
+                 &RpcMethodMetrics::total, TIME_BUCKETS, n_times);
+
+    if (RpcPerf::enabled()) {
+        putCounter(text, "rpc_perf_sampled_total",
+                   "Handler calls measured with performance counters.", methods,
+                   &RpcMethodMetrics::sampled);
+        putPerf(text, "rpc_perf_cycles_total",
+                "CPU cycles spent in handlers.", methods, &RpcPerfSample::cycles);
+        putPerf(text, "rpc_perf_instructions_total",
+                "Instructions retired in handlers.", methods, &RpcPerfSample::instructions);
+        putPerf(text, "rpc_perf_cache_misses_total",
+                "Cache misses in handlers.", methods, &RpcPerfSample::cache_misses);
+        putPerf(text, "rpc_perf_branch_misses_total",
+                "Branch misses in handlers.", methods, &RpcPerfSample::branch_misses);
+    }
+    return text;
+}
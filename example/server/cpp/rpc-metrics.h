@@ -0,0 +1,69 @@
+#ifndef RPC_METRICS_H
+#define RPC_METRICS_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+
+#include "rpc-histogram.h"
+#include "rpc-perf.h"
+
+struct RpcMethodMetrics
+{
+    RpcMethodMetrics() : requests(0), errors(0), sampled(0) {}
+
+    quint64 requests;
+    quint64 errors;
+    quint64 sampled;    // handler calls with performance counters
+    RpcPerfSample perf; // sums of the handlers' counters
+    RpcHistogram size;  // request envelope [bytes]
+    RpcHistogram wait;  // queued until a worker picks it up [us]
+    RpcHistogram exec;  // processing on the worker [us]
+    RpcHistogram total; // queued until the result is back on the I/O thread [us]
+};
+
+//
+// Per method counters and histograms, sharded per thread: A thread records
+// into its own shard only, whose mutex is hence uncontended except while a
+// scrape merges the shards. Shards of finished threads are folded into a
+// retired one, such that their counts survive the thread pool's expiry.
+//
+
+class RpcMetrics
+{
+public:
+    static RpcMetrics *instance();
+    static qint64 now();
+
+    static bool enabled() { return s_enabled; }
+    static void setEnabled(bool value) { s_enabled = value; }
+
+    void record(const QByteArray &method, quint64 size, qint64 wait, qint64 exec, bool error);
+    void recordTotal(const QByteArray &method, qint64 total);
+    void recordPerf(const QByteArray &method, const RpcPerfSample &sample);
+
+    QHash<QByteArray, RpcMethodMetrics> snapshot() const;
+    QByteArray prometheus() const;
+
+public:
+    struct Shard {
+        QMutex mutex;
+        QHash<QByteArray, RpcMethodMetrics> methods;
+    };
+    void retire(Shard *shard);
+
+private:
+    RpcMetrics();
+    Shard *shard();
+    static void merge(QHash<QByteArray, RpcMethodMetrics> &lhs,
+                      const QHash<QByteArray, RpcMethodMetrics> &rhs);
+
+private:
+    static bool s_enabled;
+    mutable QMutex m_mutex;
+    QList<Shard*> m_shards;
+    QHash<QByteArray, RpcMethodMetrics> m_retired;
+};
+
+#endif // RPC_METRICS_H
@@ -0,0 +1,117 @@
+#include "rpc-perf.h"
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QDebug>
+#include <QtCore/QThreadStorage>
+
+#ifdef Q_OS_LINUX
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+    bool g_enabled = false;
+
+#ifdef Q_OS_LINUX
+    const quint64 COUNTERS[][2] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+    };
+    const int N_COUNTERS = 4;
+
+    struct RpcPerfGroup {
+        RpcPerfGroup() : leader(-1) {
+            for (int i = 0; i < N_COUNTERS; i++) {
+                fds[i] = -1;
+            }
+        }
+        ~RpcPerfGroup() {
+            for (int i = N_COUNTERS - 1; i >= 0; i--) {
+                if (fds[i] >= 0) {
+                    close(fds[i]);
+                }
+            }
+        }
+        bool open() {
+            for (int i = 0; i < N_COUNTERS; i++) {
+                struct perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = quint32(COUNTERS[i][0]);
+                attr.config = COUNTERS[i][1];
+                attr.disabled = i == 0 ? 1 : 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP;
+
+                fds[i] = int(syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0));
+                if (fds[i] < 0) {
+                    return false;
+                }
+                if (i == 0) {
+                    leader = fds[0];
+                }
+            }
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            return true;
+        }
+        int leader;
+        int fds[N_COUNTERS];
+    };
+
+    QThreadStorage<RpcPerfGroup*> g_groups;
+    QAtomicInt g_warned(0);
+#endif
+}
+
+bool RpcPerf::enabled() {
+    return g_enabled;
+}
+
+void RpcPerf::setEnabled(bool value) {
+    g_enabled = value;
+}
+
+bool RpcPerf::read(RpcPerfSample *sample) {
+    Q_ASSERT(sample);
+#ifdef Q_OS_LINUX
+    if (!g_groups.hasLocalData()) {
+        RpcPerfGroup *group = new RpcPerfGroup();
+        Q_ASSERT(group);
+        if (!group->open()) {
+            if (g_warned.testAndSetRelaxed(0, 1)) {
+                qWarning() << "[perf]" << "perf_event_open:" << strerror(errno);
+            }
+            group->leader = -1;
+        }
+        g_groups.setLocalData(group);
+    }
+
+    RpcPerfGroup *group = g_groups.localData();
+    if (group->leader < 0) {
+        return false;
+    }
+
+    quint64 values[1 + N_COUNTERS];
+    ssize_t size = ::read(group->leader, values, sizeof(values));
+    if (size != ssize_t(sizeof(values)) || values[0] != quint64(N_COUNTERS)) {
+        return false;
+    }
+
+    sample->cycles = values[1];
+    sample->instructions = values[2];
+    sample->cache_misses = values[3];
+    sample->branch_misses = values[4];
+    return true;
+#else
+    Q_UNUSED(sample);
+    return false;
+#endif
+}
@@ -0,0 +1,45 @@
+#ifndef RPC_PERF_H
+#define RPC_PERF_H
+
+#include <QtCore/QtGlobal>
+
+//
+// Hardware performance counters of the calling thread (via perf_event_open
+// on Linux): cycles, instructions, cache and branch misses in user space.
+// The counters of a thread are opened as one group on its first `read`; if
+// that fails (e.g. due to perf_event_paranoid) `read` keeps returning false.
+//
+
+struct RpcPerfSample
+{
+    RpcPerfSample() : cycles(0), instructions(0), cache_misses(0), branch_misses(0) {}
+
+    quint64 cycles;
+    quint64 instructions;
+    quint64 cache_misses;
+    quint64 branch_misses;
+
+    RpcPerfSample operator-(const RpcPerfSample &rhs) const {
+        RpcPerfSample delta;
+        delta.cycles = cycles - rhs.cycles;
+        delta.instructions = instructions - rhs.instructions;
+        delta.cache_misses = cache_misses - rhs.cache_misses;
+        delta.branch_misses = branch_misses - rhs.branch_misses;
+        return delta;
+    }
+    RpcPerfSample &operator+=(const RpcPerfSample &rhs) {
+        cycles += rhs.cycles;
+        instructions += rhs.instructions;
+        cache_misses += rhs.cache_misses;
+        branch_misses += rhs.branch_misses;
+        return *this;
+    }
+};
+
+namespace RpcPerf {
+    bool enabled();
+    void setEnabled(bool value);
+    bool read(RpcPerfSample *sample);
+}
+
+#endif // RPC_PERF_H
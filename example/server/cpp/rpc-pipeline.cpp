@@ -0,0 +1,200 @@
+#include "rpc-pipeline.h"
+#include "rpc-batch.h"
+#include "rpc-executor.h"
+
+#include "protocol/rpc.pb.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+namespace {
+    enum RpcPipelineState {
+        Pending, Resolved, Failed
+    };
+}
+
+RpcPipeline::RpcPipeline(RpcExecutor *executor, quint64 client)
+    : m_executor(executor), m_client(client), m_token(NULL)
+{
+}
+
+QByteArray RpcPipeline::process(const std::string &data) {
+    QVector<QByteArray> slices = RpcBatch::slice(data);
+    QVector<Rpc_Request> requests(slices.size());
+    QVector<QByteArray> responses(slices.size());
+    QVector<RpcPipelineState> states(slices.size(), Pending);
+    QHash<quint32, int> index;
+
+    for (int i = 0; i < slices.size(); i++) {
+        bool req_parsed = requests[i].ParseFromArray(
+                    slices[i].constData(), slices[i].length());
+        if (!req_parsed) {
+            qWarning() << "[on:error]" << ".Rpc.Pipeline: invalid request";
+            states[i] = Failed;
+            continue;
+        }
+        index.insert(requests[i].id(), i);
+    }
+
+    RpcBatch batch(m_executor, m_client);
+    batch.setToken(m_token);
+    forever {
+        if (m_token && m_token->cancelled()) {
+            return QByteArray(); // nobody waits for the responses
+        }
+        QVector<int> wave;
+        bool failed = false;
+
+        for (int i = 0; i < requests.size(); i++) {
+            if (states[i] != Pending) {
+                continue;
+            }
+            RpcPipelineState state = Resolved;
+            for (int b = 0; b < requests[i].binds_size(); b++) {
+                int source = index.value(requests[i].binds(b).source(), -1);
+                if (source < 0 || source == i || states[source] == Failed) {
+                    state = Failed;
+                    break;
+                }
+                if (states[source] == Pending) {
+                    state = Pending;
+                }
+            }
+            if (state == Failed) {
+                qWarning() << "[on:error]" << requests[i].name().c_str() << ": unresolved bind";
+                states[i] = Failed;
+                failed = true;
+            } else if (state == Resolved) {
+                wave << i;
+            }
+        }
+        if (wave.isEmpty()) {
+            if (failed) {
+                continue;
+            }
+            break;
+        }
+
+        //
+        // Apply the binds, and run the wave like a batch:
+        //
+
+        QVector<int> bound_wave;
+        QVector<QByteArray> wave_reqs, wave_ress;
+        foreach (int i, wave) {
+            Rpc_Request request = requests[i];
+            bool bound = true;
+            for (int b = 0; b < request.binds_size() && bound; b++) {
+                const Rpc_Bind &bind = request.binds(b);
+                Rpc_Response source;
+                const QByteArray &source_bytes = responses[index.value(bind.source())];
+                bound = source.ParseFromArray(
+                            source_bytes.constData(), source_bytes.length())
+                        && RpcPipeline::bind(
+                            source.data(), bind.source_field(), bind.target_field(),
+                            request.mutable_data());
+            }
+            if (!bound) {
+                qWarning() << "[on:error]" << request.name().c_str() << ": invalid bind";
+                states[i] = Failed;
+                continue;
+            }
+            request.clear_binds();
+            wave_reqs << QByteArray::fromStdString(request.SerializeAsString());
+            bound_wave << i;
+        }
+
+        batch.run(wave_reqs, &wave_ress);
+        for (int w = 0; w < bound_wave.size(); w++) {
+            responses[bound_wave[w]] = wave_ress[w];
+            states[bound_wave[w]] = wave_ress[w].isEmpty() ? Failed : Resolved;
+        }
+    }
+
+    //
+    // Whatever is still pending depends on a cycle:
+    //
+
+    for (int i = 0; i < requests.size(); i++) {
+        if (states[i] == Pending) {
+            qWarning() << "[on:error]" << requests[i].name().c_str() << ": cyclic bind";
+        }
+    }
+    return RpcBatch::join(responses);
+}
+
+bool RpcPipeline::bind(const std::string &source, quint32 source_field,
+                       quint32 target_field, std::string *target) {
+    Q_ASSERT(target);
+    CodedInputStream input(
+                reinterpret_cast<const quint8*>(source.data()), int(source.size()));
+
+    //
+    // The last occurrence of the source field is the one in effect:
+    //
+
+    if (target_field == 0) {
+        return false;
+    }
+
+    quint32 wire_type = 0;
+    int offset = -1, length = 0;
+    while (quint32 tag = input.ReadTag()) {
+        int begin = input.CurrentPosition();
+        if (!WireFormatLite::SkipField(&input, tag)) {
+            return false;
+        }
+        if (WireFormatLite::GetTagFieldNumber(tag) == int(source_field)) {
+            wire_type = WireFormatLite::GetTagWireType(tag);
+            offset = begin;
+            length = input.CurrentPosition() - begin;
+        }
+    }
+
+    //
+    // An absent field has its default value, hence so must the target have,
+    // i.e. any value the client put there is stripped:
+    //
+
+    if (offset < 0) {
+        return RpcPipeline::strip(target_field, target);
+    }
+
+    quint8 tag[5]; // at most 5 bytes for a varint32
+    quint8 *tag_end = CodedOutputStream::WriteVarint32ToArray(
+                (target_field << 3) | wire_type, tag);
+    target->append(reinterpret_cast<const char*>(tag), size_t(tag_end - tag));
+    target->append(source, size_t(offset), size_t(length));
+    return true;
+}
+
+bool RpcPipeline::strip(quint32 field, std::string *data) {
+    Q_ASSERT(data);
+    CodedInputStream input(
+                reinterpret_cast<const quint8*>(data->data()), int(data->size()));
+
+    std::string stripped;
+    forever {
+        int begin = input.CurrentPosition();
+        quint32 tag = input.ReadTag();
+        if (tag == 0) {
+            break;
+        }
+        if (!WireFormatLite::SkipField(&input, tag)) {
+            return false;
+        }
+        if (WireFormatLite::GetTagFieldNumber(tag) != int(field)) {
+            stripped.append(*data, size_t(begin), size_t(input.CurrentPosition() - begin));
+        }
+    }
+    data->swap(stripped);
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef RPC_PIPELINE_H
+#define RPC_PIPELINE_H
+
+#include <QtCore/QByteArray>
+
+#include <string>
+
+class RpcExecutor;
+class RpcToken;
+
+//
+// Processes the requests of an `Rpc.Batch` sent as `.Rpc.Pipeline`, whose
+// binds make up a dependency DAG: The requests run in waves, each wave being
+// those whose sources are all resolved, and each wave runs in parallel like
+// a plain batch. Binds are applied on the wire, by appending the source's
+// field (re-tagged as the target field) to the request's data, since for a
+// scalar field the last occurrence wins; an absent (i.e. zero) source field
+// strips the target field instead. Once its token is cancelled, no
+// further waves are run.
+//
+
+class RpcPipeline
+{
+public:
+    explicit RpcPipeline(RpcExecutor *executor, quint64 client = 0);
+
+    QByteArray process(const std::string &data);
+
+    static bool bind(const std::string &source, quint32 source_field,
+                     quint32 target_field, std::string *target);
+    static bool strip(quint32 field, std::string *data);
+
+private:
+    RpcExecutor *m_executor;
+    quint64 m_client;
+
+private:
+    const RpcToken *m_token;
+public:
+    const RpcToken *getToken() { return m_token; }
+    void setToken(const RpcToken *value) { m_token = value; }
+};
+
+#endif // RPC_PIPELINE_H
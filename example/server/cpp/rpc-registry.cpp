@@ -0,0 +1,75 @@
+#include "rpc-registry.h"
+
+RpcRegistry::RpcRegistry()
+    : m_count(0) {
+}
+
+quint64 RpcRegistry::insert(QObject *socket, RpcConnection::Kind kind) {
+    Q_ASSERT(socket);
+
+    quint32 index;
+    if (m_free.isEmpty()) {
+        index = m_slots.size();
+        Slot slot;
+        slot.generation = 1;
+        slot.used = false;
+        m_slots.append(slot);
+    } else {
+        index = m_free.takeLast();
+    }
+
+    Slot &slot = m_slots[index];
+    Q_ASSERT(!slot.used);
+    slot.used = true;
+    slot.connection = RpcConnection();
+    slot.connection.id = (quint64(slot.generation) << 32) | index;
+    slot.connection.socket = socket;
+    slot.connection.kind = kind;
+    slot.connection.delimited = false;
+    slot.connection.sweep = 0;
+
+    m_count += 1;
+    return slot.connection.id;
+}
+
+bool RpcRegistry::remove(quint64 id) {
+    if (get(id) == NULL) {
+        return false;
+    }
+
+    Slot &slot = m_slots[quint32(id)];
+    slot.used = false;
+    slot.connection = RpcConnection();
+    slot.generation += 1;
+    if (slot.generation == 0) {
+        slot.generation = 1;
+    }
+    m_free.append(quint32(id));
+
+    m_count -= 1;
+    Q_ASSERT(m_count >= 0);
+    return true;
+}
+
+RpcConnection *RpcRegistry::get(quint64 id) {
+    quint32 index = quint32(id);
+    if (index >= quint32(m_slots.size())) {
+        return NULL;
+    }
+
+    Slot &slot = m_slots[index];
+    if (!slot.used || slot.generation != quint32(id >> 32)) {
+        return NULL;
+    }
+    return &slot.connection;
+}
+
+QList<quint64> RpcRegistry::ids() const {
+    QList<quint64> list;
+    foreach(const Slot &slot, m_slots) {
+        if (slot.used) {
+            list << slot.connection.id;
+        }
+    }
+    return list;
+}
@@ -0,0 +1,67 @@
+#ifndef RPC_REGISTRY_H
+#define RPC_REGISTRY_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QVector>
+
+class RpcToken;
+
+//
+// Per connection state: Subsystems keeping track of a client should store
+// their data here (rather than in maps keyed by socket pointers), since an
+// entry is dropped in O(1) together with its connection.
+//
+
+struct RpcConnection
+{
+    enum Kind { Tcp, Ws, WsRaw };
+
+    quint64 id;
+    QObject *socket;
+    Kind kind;
+
+    bool delimited;
+    QList<QByteArray> pending;
+    QList<quint64> traces;
+    qint64 active;
+
+    QHash<quint32, QSharedPointer<RpcToken> > tokens; // by request id
+    int sweep; // tokens size to drop finished ones at
+};
+
+//
+// Slot map of connections: Insertion and removal are O(1) and the returned
+// ids are stable, i.e. an id of a removed connection is never handed out
+// again (as long as a slot's 32 bit generation does not wrap around), such
+// that a late lookup by a worker's result yields NULL instead of a dangling
+// socket. Pointers returned by `get` are valid until the next `insert`.
+//
+
+class RpcRegistry
+{
+public:
+    RpcRegistry();
+
+    quint64 insert(QObject *socket, RpcConnection::Kind kind);
+    bool remove(quint64 id);
+    RpcConnection *get(quint64 id);
+
+    QList<quint64> ids() const;
+    int count() const { return m_count; }
+
+private:
+    struct Slot {
+        quint32 generation;
+        bool used;
+        RpcConnection connection;
+    };
+    QVector<Slot> m_slots;
+    QVector<quint32> m_free;
+    int m_count;
+};
+
+#endif // RPC_REGISTRY_H
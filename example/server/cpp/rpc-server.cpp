@@ -1,17 +1,55 @@
 #include "rpc-server.h"
 #include "rpc-task.h"
 #include "rpc-http.h"
+#include "rpc-delimited.h"
+#include "rpc-websocket.h"
+#include "rpc-wheel.h"
+#include "rpc-metrics.h"
+#include "rpc-trace.h"
+#include "rpc-log.h"
+#include "rpc-capture.h"
+#include "rpc-executor.h"
+#include "rpc-usdt.h"
 
 #include <QtCore/QDebug>
 #include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
+#include <QtCore/QUrlQuery>
 #include <QtNetwork/QTcpServer>
 #include <QtNetwork/QTcpSocket>
 #include <QtWebSockets/QtWebSockets>
 
-RpcServer::RpcServer(quint16 port_tcp, quint16 port_ws, QObject *parent)
-    : QObject(parent), m_logging(false)
+#define RPC_SERVER_SWEEP 64
+
+RpcServer::RpcServer(quint16 port_tcp, quint16 port_ws, bool ws_raw, int ws_deflate, QObject *parent)
+    : QObject(parent), m_tcp_timeout(0), m_ws_timeout(0),
+      m_server_ws(NULL), m_server_ws_raw(NULL), m_ws_deflate(ws_deflate), m_logging(false), m_capture(NULL)
 {
     GOOGLE_PROTOBUF_VERIFY_VERSION;
+    qRegisterMetaType<RpcStamp>("RpcStamp");
+
+    m_wheel = new RpcWheel(1000, 64, this);
+    Q_ASSERT(m_wheel);
+
+    QObject::connect(
+                m_wheel, &RpcWheel::expired, this, &RpcServer::onIdle);
+
+    m_executor = new RpcExecutor(QThreadPool::globalInstance(), this);
+    Q_ASSERT(m_executor);
+
+    //
+    // Health checks overtake, while bulk requests (which occupy a worker for
+    // long) yield to the rest; the envelope's priority overrides these.
+    //
+
+    m_executor->setPriority(".Reflector.Service.ack", RpcExecutor::High);
+    m_executor->setPriority(".Calculator.Service.eval", RpcExecutor::Low);
+    m_executor->setPriority(".Calculator.Service.addBatch", RpcExecutor::Low);
+    m_executor->setPriority(".Calculator.Service.subBatch", RpcExecutor::Low);
+    m_executor->setPriority(".Calculator.Service.mulBatch", RpcExecutor::Low);
+    m_executor->setPriority(".Calculator.Service.divBatch", RpcExecutor::Low);
+    m_executor->setPriority(".Rpc.Batch", RpcExecutor::Low);
+    m_executor->setPriority(".Rpc.Pipeline", RpcExecutor::Low);
 
     m_server_tcp = new QTcpServer();
     Q_ASSERT(m_server_tcp);
@@ -21,27 +59,55 @@ RpcServer::RpcServer(quint16 port_tcp, quint16 port_ws, QObject *parent)
     QObject::connect(
                 m_server_tcp, &QTcpServer::newConnection, this, &RpcServer::onTcpConnection);
 
-    m_server_ws = new QWebSocketServer(QStringLiteral("ws-server"), QWebSocketServer::NonSecureMode);
-    Q_ASSERT(m_server_ws);
-    bool listening_ws = m_server_ws->listen(QHostAddress::Any, port_ws);
-    Q_ASSERT(listening_ws);
+    if (!ws_raw && m_ws_deflate < 0) {
+        m_server_ws = new QWebSocketServer(QStringLiteral("ws-server"), QWebSocketServer::NonSecureMode);
+        Q_ASSERT(m_server_ws);
+        bool listening_ws = m_server_ws->listen(QHostAddress::Any, port_ws);
+        Q_ASSERT(listening_ws);
+
+        QObject::connect(
+                    m_server_ws, &QWebSocketServer::newConnection, this, &RpcServer::onWsConnection);
+        QObject::connect(
+                    m_server_ws, &QWebSocketServer::closed, this, &RpcServer::closed);
+    } else {
+        m_server_ws_raw = new QTcpServer();
+        Q_ASSERT(m_server_ws_raw);
+        bool listening_ws = m_server_ws_raw->listen(QHostAddress::Any, port_ws);
+        Q_ASSERT(listening_ws);
+
+        QObject::connect(
+                    m_server_ws_raw, &QTcpServer::newConnection, this, &RpcServer::onWsRawConnection);
+    }
+
+    m_flush_ws = new QTimer(this);
+    Q_ASSERT(m_flush_ws);
+    m_flush_ws->setSingleShot(true);
+    m_flush_ws->setInterval(0);
 
     QObject::connect(
-                m_server_ws, &QWebSocketServer::newConnection, this, &RpcServer::onWsConnection);
-    QObject::connect(
-                m_server_ws, &QWebSocketServer::closed, this, &RpcServer::closed);
+                m_flush_ws, &QTimer::timeout, this, &RpcServer::onWsFlush);
 }
 
 RpcServer::~RpcServer() {
     m_server_tcp->close();
     Q_ASSERT(!m_server_tcp->isListening());
-    qDeleteAll(m_client_tcp.begin(), m_client_tcp.end());
-    Q_ASSERT(m_client_tcp.empty());
 
-    m_server_ws->close();
-    Q_ASSERT(!m_server_ws->isListening());
-    qDeleteAll(m_client_ws.begin(), m_client_ws.end());
-    Q_ASSERT(m_client_ws.empty());
+    if (m_server_ws) {
+        m_server_ws->close();
+        Q_ASSERT(!m_server_ws->isListening());
+    }
+    if (m_server_ws_raw) {
+        m_server_ws_raw->close();
+        Q_ASSERT(!m_server_ws_raw->isListening());
+    }
+
+    foreach(quint64 id, m_clients.ids()) {
+        RpcConnection *connection = m_clients.get(id);
+        Q_ASSERT(connection);
+        delete connection->socket;
+        m_clients.remove(id);
+    }
+    Q_ASSERT(m_clients.count() == 0);
 }
 
 void RpcServer::onTcpConnection() {
@@ -51,49 +117,82 @@ void RpcServer::onTcpConnection() {
     Q_ASSERT(socket->isReadable());
     Q_ASSERT(socket->isWritable());
 
+    quint64 id = m_clients.insert(socket, RpcConnection::Tcp);
+    Q_ASSERT(id);
+    watch(m_clients.get(id));
+    if (RpcTrace::enabled()) {
+        RpcTrace::mark(RpcTrace::Accept, id);
+    }
+
     QObject::connect(
-                socket, &QTcpSocket::readyRead, this, &RpcServer::onTcpMessage);
+                socket, &QTcpSocket::readyRead, this, [this, id]() { onTcpMessage(id); });
     QObject::connect(
-                socket, &QTcpSocket::disconnected, this, &RpcServer::onTcpDisconnect);
-
-    m_client_tcp << socket;
-    Q_ASSERT(!m_client_tcp.empty());
+                socket, &QTcpSocket::disconnected, this, [this, id]() { onTcpDisconnect(id); });
 }
 
-void RpcServer::onTcpDisconnect() {
-    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+void RpcServer::onTcpDisconnect(quint64 id) {
+    RpcConnection *connection = m_clients.get(id);
+    Q_ASSERT(connection);
+    cancelAll(connection);
+    QObject *socket = connection->socket;
     Q_ASSERT(socket);
-    int length = m_client_tcp.count();
-    Q_ASSERT(length > 0);
-    m_client_tcp.removeAll(socket);
-    Q_ASSERT(m_client_tcp.count() < length);
+    bool removed = m_clients.remove(id);
+    Q_ASSERT(removed);
 
     socket->deleteLater();
 }
 
-void RpcServer::onTcpMessage() {
-    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+void RpcServer::onTcpMessage(quint64 id) {
+    RpcConnection *connection = m_clients.get(id);
+    Q_ASSERT(connection);
+    QTcpSocket *socket = (QTcpSocket*)connection->socket;
     Q_ASSERT(socket);
+    quint64 trace = RpcTrace::enabled() ? RpcTrace::next() : 0;
+    if (trace) {
+        RpcTrace::mark(RpcTrace::Read, id, trace);
+    }
     QByteArray bytes = socket->readAll();
     Q_ASSERT(bytes.length() > 0);
+    touch(connection);
 
     if (this->getLogging()) {
-        qDebug() << "[on:message]" << bytes;
+        RpcLog::instance()->log("[on:message]", bytes);
     }
 
-    RpcTask *rpc_task = new RpcTask(RpcHttp::GetBody(bytes), socket);
-    rpc_task->setAutoDelete(true);
+    QByteArray body = RpcHttp::GetBody(bytes);
+    if (trace) {
+        RpcTrace::mark(RpcTrace::Framed, id, trace);
+    }
+    if (m_capture) {
+        m_capture->append(RpcCapture::Xhr, id, body);
+    }
+    RpcHeader header;
+    RpcTask::Peek(body, &header);
+    RPC_PROBE4(tcp__message, id, header.id, header.name.constData(), body.length());
 
-    QObject::connect(
-                rpc_task, &RpcTask::result, this, &RpcServer::onTcpTask,
-                Qt::QueuedConnection);
+    RpcTask *rpc_task = new RpcTask(body, id, trace);
+    rpc_task->setAutoDelete(true);
+    track(connection, rpc_task, header);
 
-    QThreadPool::globalInstance()->start(rpc_task);
+    m_executor->start(rpc_task, rpc_task->getToken(),
+                      m_executor->priority(header.name, header.priority), id);
 }
 
-void RpcServer::onTcpTask(QByteArray bytes, void *client) {
+void RpcServer::onTcpTask(QByteArray bytes, quint64 id, RpcStamp stamp) {
     Q_ASSERT(bytes.length() > 0);
-    QTcpSocket *socket = (QTcpSocket*)client;
+    RPC_PROBE4(tcp__task, id, stamp.id, stamp.method.constData(), bytes.length());
+    RpcConnection *connection = m_clients.get(id);
+    if (connection == NULL) {
+        return; // client is gone
+    }
+    connection->tokens.remove(stamp.id);
+    if (stamp.queued) {
+        RpcMetrics::instance()->recordTotal(stamp.method, RpcMetrics::now() - stamp.queued);
+    }
+    if (stamp.trace) {
+        RpcTrace::mark(RpcTrace::Delivered, id, stamp.trace);
+    }
+    QTcpSocket *socket = (QTcpSocket*)connection->socket;
     Q_ASSERT(socket != NULL);
     QByteArray http = RpcHttp::PutHeaders(bytes);
     Q_ASSERT(http.length() > bytes.length());
@@ -107,6 +206,9 @@ void RpcServer::onTcpTask(QByteArray bytes, void *client) {
     qint64 to_write = socket->bytesToWrite();
     Q_ASSERT(to_write == 0);
 
+    if (stamp.trace) {
+        RpcTrace::mark(RpcTrace::Written, id, stamp.trace);
+    }
     socket->close();
 }
 
@@ -114,48 +216,323 @@ void RpcServer::onWsConnection() {
     QWebSocket *socket = m_server_ws->nextPendingConnection();
     Q_ASSERT(socket);
 
+    quint64 id = m_clients.insert(socket, RpcConnection::Ws);
+    Q_ASSERT(id);
+    watch(m_clients.get(id));
+    if (RpcTrace::enabled()) {
+        RpcTrace::mark(RpcTrace::Accept, id);
+    }
+
     QObject::connect(
-                socket, &QWebSocket::binaryMessageReceived, this, &RpcServer::onWsMessage);
+                socket, &QWebSocket::binaryMessageReceived, this,
+                [this, id](QByteArray bytes) { onWsMessage(id, bytes); });
     QObject::connect(
-                socket, &QWebSocket::disconnected, this, &RpcServer::onWsDisconnect);
+                socket, &QWebSocket::disconnected, this, [this, id]() { onWsDisconnect(id); });
 
-    m_client_ws << socket;
-    Q_ASSERT(!m_client_ws.empty());
+    onWsOpen(id);
+}
+
+void RpcServer::onWsRawConnection() {
+    QTcpSocket *tcp_socket = m_server_ws_raw->nextPendingConnection();
+    Q_ASSERT(tcp_socket);
+    RpcWebSocket *socket = new RpcWebSocket(tcp_socket, m_ws_deflate);
+    Q_ASSERT(socket);
+
+    quint64 id = m_clients.insert(socket, RpcConnection::WsRaw);
+    Q_ASSERT(id);
+    watch(m_clients.get(id));
+    if (RpcTrace::enabled()) {
+        RpcTrace::mark(RpcTrace::Accept, id);
+    }
+
+    QObject::connect(
+                socket, &RpcWebSocket::connected, this, [this, id]() { onWsOpen(id); });
+    QObject::connect(
+                socket, &RpcWebSocket::binaryMessageReceived, this,
+                [this, id](QByteArray bytes) { onWsMessage(id, bytes); });
+    QObject::connect(
+                socket, &RpcWebSocket::disconnected, this, [this, id]() { onWsDisconnect(id); });
 }
 
-void RpcServer::onWsDisconnect() {
-    QWebSocket *client = qobject_cast<QWebSocket*>(sender());
+void RpcServer::onWsOpen(quint64 id) {
+    RpcConnection *connection = m_clients.get(id);
+    Q_ASSERT(connection);
+
+    QUrl url = connection->kind == RpcConnection::WsRaw
+            ? ((RpcWebSocket*)connection->socket)->requestUrl()
+            : ((QWebSocket*)connection->socket)->requestUrl();
+    QUrlQuery query(url);
+    if (query.queryItemValue("encoding") == QStringLiteral("delimited")) {
+        connection->delimited = true;
+    }
+}
+
+void RpcServer::onWsDisconnect(quint64 id) {
+    RpcConnection *connection = m_clients.get(id);
+    Q_ASSERT(connection);
+    cancelAll(connection);
+    QObject *client = connection->socket;
     Q_ASSERT(client);
-    int length = m_client_ws.count();
-    Q_ASSERT(length > 0);
-    m_client_ws.removeAll(client);
-    Q_ASSERT(m_client_ws.count() < length);
+    bool removed = m_clients.remove(id);
+    Q_ASSERT(removed);
 
     client->deleteLater();
 }
 
-void RpcServer::onWsMessage(QByteArray bytes) {
-    QWebSocket *client = qobject_cast<QWebSocket*>(sender());
-    Q_ASSERT(client);
+void RpcServer::onWsMessage(quint64 id, QByteArray bytes) {
+    RpcConnection *connection = m_clients.get(id);
+    Q_ASSERT(connection);
+    touch(connection);
 
     if (this->getLogging()) {
-        qDebug() << "[on:message]" << bytes;
+        RpcLog::instance()->log("[on:message]", bytes);
     }
 
-    RpcTask *rpc_task = new RpcTask(bytes, client);
-    rpc_task->setAutoDelete(true);
+    QList<QByteArray> messages;
+    if (connection->delimited) {
+        messages = RpcDelimited::Split(bytes);
+    } else {
+        messages << bytes;
+    }
+
+    //
+    // The WS engines hand over complete messages only, hence their requests
+    // start with the framed stage (instead of the read one).
+    //
+
+    foreach(QByteArray message, messages) {
+        quint64 trace = RpcTrace::enabled() ? RpcTrace::next() : 0;
+        if (trace) {
+            RpcTrace::mark(RpcTrace::Framed, id, trace);
+        }
+        if (m_capture) {
+            m_capture->append(RpcCapture::Ws, id, message);
+        }
+        RpcHeader header;
+        RpcTask::Peek(message, &header);
+        RPC_PROBE4(ws__message, id, header.id, header.name.constData(), message.length());
+        if (header.cancel) {
+            cancel(connection, header.id);
+            continue;
+        }
+
+        RpcTask *rpc_task = new RpcTask(message, id, trace);
+        rpc_task->setAutoDelete(true);
+        track(connection, rpc_task, header);
+
+        m_executor->start(rpc_task, rpc_task->getToken(),
+                          m_executor->priority(header.name, header.priority), id);
+    }
+}
+
+void RpcServer::onWsTask(QByteArray bytes, quint64 id, RpcStamp stamp) {
+    Q_ASSERT(bytes.length() > 0);
+    RPC_PROBE4(ws__task, id, stamp.id, stamp.method.constData(), bytes.length());
+    RpcConnection *connection = m_clients.get(id);
+    if (connection == NULL) {
+        return; // client is gone
+    }
+    connection->tokens.remove(stamp.id);
+    if (stamp.queued) {
+        RpcMetrics::instance()->recordTotal(stamp.method, RpcMetrics::now() - stamp.queued);
+    }
+    if (stamp.trace) {
+        RpcTrace::mark(RpcTrace::Delivered, id, stamp.trace);
+        connection->traces << stamp.trace;
+    }
+
+    if (connection->pending.isEmpty()) {
+        m_pending_ws << id;
+    }
+    connection->pending << bytes;
+
+    if (!m_flush_ws->isActive()) {
+        m_flush_ws->start();
+    }
+}
+
+void RpcServer::onWsFlush() {
+    QList<quint64> pending;
+    pending.swap(m_pending_ws);
+    Q_ASSERT(m_pending_ws.empty());
+
+    foreach(quint64 id, pending) {
+        RpcConnection *connection = m_clients.get(id);
+        if (connection == NULL) {
+            continue; // client is gone
+        }
+
+        QList<QByteArray> messages;
+        messages.swap(connection->pending);
+        Q_ASSERT(!messages.isEmpty());
+
+        //
+        // A closing connection sends nothing anymore, whereupon the rest of
+        // its responses are dropped:
+        //
+
+        bool sent = true;
+        if (connection->delimited) {
+            QByteArray frame = RpcDelimited::Join(messages);
+            sent = sendWs(connection, frame) == frame.length();
+        } else {
+            foreach(QByteArray bytes, messages) {
+                if (sendWs(connection, bytes) != bytes.length()) {
+                    sent = false;
+                    break;
+                }
+            }
+        }
+        if (!sent) {
+            connection->traces.clear();
+            continue;
+        }
+
+        flushWs(connection);
+        touch(connection);
+
+        foreach(quint64 trace, connection->traces) {
+            RpcTrace::mark(RpcTrace::Written, id, trace);
+        }
+        connection->traces.clear();
+    }
+}
+
+qint64 RpcServer::sendWs(RpcConnection *connection, QByteArray bytes) {
+    if (connection->kind == RpcConnection::WsRaw) {
+        return ((RpcWebSocket*)connection->socket)->sendBinaryMessage(bytes);
+    } else {
+        return ((QWebSocket*)connection->socket)->sendBinaryMessage(bytes);
+    }
+}
+
+bool RpcServer::flushWs(RpcConnection *connection) {
+    if (connection->kind == RpcConnection::WsRaw) {
+        return ((RpcWebSocket*)connection->socket)->flush();
+    } else {
+        return ((QWebSocket*)connection->socket)->flush();
+    }
+}
+
+int RpcServer::getTimeout(RpcConnection *connection) {
+    if (connection->kind == RpcConnection::Tcp) {
+        return m_tcp_timeout;
+    } else {
+        return m_ws_timeout;
+    }
+}
+
+void RpcServer::watch(RpcConnection *connection) {
+    Q_ASSERT(connection);
+    connection->active = m_wheel->now();
+
+    int timeout = getTimeout(connection);
+    if (timeout > 0) {
+        m_wheel->schedule(connection->id, connection->active + 1000 * timeout);
+    }
+}
+
+void RpcServer::touch(RpcConnection *connection) {
+    Q_ASSERT(connection);
+    connection->active = m_wheel->now();
+}
+
+//
+// Every queued task gets a cancellation token, kept per connection by the
+// request id: A cancel frame or the connection's end cancels the tasks.
+// Tokens are dropped once the task's result is delivered, or else (for a
+// failed task) by a sweep whenever the tokens doubled since the last one.
+//
+
+void RpcServer::track(RpcConnection *connection, RpcTask *task, const RpcHeader &header) {
+    Q_ASSERT(connection);
+    Q_ASSERT(task);
+    task->setHeader(header);
+    task->setExecutor(m_executor);
+    if (header.timeout > 0) {
+        task->setDeadline(RpcMetrics::now() + qint64(header.timeout) * 1000000);
+    }
+
+    QSharedPointer<RpcToken> token(new RpcToken());
+    Q_ASSERT(token);
+    task->setToken(token);
+
+    if (connection->tokens.size() >= qMax(connection->sweep, RPC_SERVER_SWEEP)) {
+        QMutableHashIterator<quint32, QSharedPointer<RpcToken> > it(connection->tokens);
+        while (it.hasNext()) {
+            if (it.next().value()->finished()) {
+                it.remove();
+            }
+        }
+        connection->sweep = 2 * connection->tokens.size();
+    }
+    connection->tokens.insert(header.id, token);
 
     QObject::connect(
-                rpc_task, &RpcTask::result, this, &RpcServer::onWsTask,
+                task, &RpcTask::result, this, &RpcServer::onTask,
                 Qt::QueuedConnection);
+}
+
+//
+// Delivers a response by the kind of its connection, which is not the one
+// of the task's own connection if the task led a flight of coalesced
+// requests (answering those which boarded it):
+//
 
-    QThreadPool::globalInstance()->start(rpc_task);
+void RpcServer::onTask(QByteArray bytes, quint64 id, RpcStamp stamp) {
+    RpcConnection *connection = m_clients.get(id);
+    if (connection == NULL) {
+        return; // client is gone
+    }
+    if (connection->kind == RpcConnection::Tcp) {
+        onTcpTask(bytes, id, stamp);
+    } else {
+        onWsTask(bytes, id, stamp);
+    }
 }
 
-void RpcServer::onWsTask(QByteArray bytes, void *client) {
-    Q_ASSERT(bytes.length() > 0);
-    QWebSocket *socket = (QWebSocket*)client;
-    Q_ASSERT(socket != NULL);
-    qint64 sent = socket->sendBinaryMessage(bytes);
-    Q_ASSERT(sent == bytes.length());
+void RpcServer::cancel(RpcConnection *connection, quint32 id) {
+    Q_ASSERT(connection);
+    QSharedPointer<RpcToken> token = connection->tokens.take(id);
+    if (token) {
+        bool queued = m_executor->cancel(token);
+        RPC_PROBE2(task__cancel, connection->id, queued);
+    }
+}
+
+void RpcServer::cancelAll(RpcConnection *connection) {
+    Q_ASSERT(connection);
+    foreach (const QSharedPointer<RpcToken> &token, connection->tokens) {
+        m_executor->cancel(token);
+    }
+    connection->tokens.clear();
+}
+
+void RpcServer::onIdle(quint64 id) {
+    RpcConnection *connection = m_clients.get(id);
+    if (connection == NULL) {
+        return; // client is gone
+    }
+
+    qint64 deadline = connection->active + 1000 * getTimeout(connection);
+    if (deadline > m_wheel->now()) {
+        m_wheel->schedule(id, deadline);
+        return;
+    }
+
+    if (this->getLogging()) {
+        qDebug() << "[on:idle]" << id;
+    }
+
+    switch (connection->kind) {
+    case RpcConnection::Tcp:
+        ((QTcpSocket*)connection->socket)->close();
+        break;
+    case RpcConnection::Ws:
+        ((QWebSocket*)connection->socket)->close(QWebSocketProtocol::CloseCodeGoingAway);
+        break;
+    case RpcConnection::WsRaw:
+        ((RpcWebSocket*)connection->socket)->close(1001);
+        break;
+    }
 }
@@ -6,38 +6,74 @@
 #include <QtCore/QObject>
 #include <QtCore/QString>
 
+#include "rpc-registry.h"
+#include "rpc-task.h"
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
 QT_FORWARD_DECLARE_CLASS(QTcpServer)
 QT_FORWARD_DECLARE_CLASS(QTcpSocket)
 QT_FORWARD_DECLARE_CLASS(QWebSocketServer)
 QT_FORWARD_DECLARE_CLASS(QWebSocket)
 
+class RpcWheel;
+class RpcCapture;
+class RpcExecutor;
+
 class RpcServer : public QObject
 {
     Q_OBJECT
 public:
-    explicit RpcServer(quint16, quint16, QObject *parent = 0);
+    explicit RpcServer(quint16, quint16, bool ws_raw = false, int ws_deflate = -1, QObject *parent = 0);
     ~RpcServer();
 
 Q_SIGNALS:
     void closed();
 
+private:
+    RpcRegistry m_clients;
+private Q_SLOTS:
+    void onTask(QByteArray, quint64, RpcStamp);
+
+private Q_SLOTS:
+    void onIdle(quint64);
+private:
+    RpcWheel *m_wheel;
+    int m_tcp_timeout;
+    int m_ws_timeout;
+    int getTimeout(RpcConnection*);
+    void watch(RpcConnection*);
+    void touch(RpcConnection*);
+public:
+    int getTcpTimeout() { return m_tcp_timeout; }
+    void setTcpTimeout(int value) { m_tcp_timeout = value; }
+    int getWsTimeout() { return m_ws_timeout; }
+    void setWsTimeout(int value) { m_ws_timeout = value; }
+
 private Q_SLOTS:
     void onTcpConnection();
-    void onTcpMessage();
-    void onTcpDisconnect();
-    void onTcpTask(QByteArray, void*);
+    void onTcpMessage(quint64);
+    void onTcpDisconnect(quint64);
+    void onTcpTask(QByteArray, quint64, RpcStamp);
 private:
     QTcpServer *m_server_tcp;
-    QList<QTcpSocket*> m_client_tcp;
 
 private Q_SLOTS:
     void onWsConnection();
-    void onWsMessage(QByteArray);
-    void onWsDisconnect();
-    void onWsTask(QByteArray, void*);
+    void onWsRawConnection();
+    void onWsOpen(quint64);
+    void onWsMessage(quint64, QByteArray);
+    void onWsDisconnect(quint64);
+    void onWsTask(QByteArray, quint64, RpcStamp);
+    void onWsFlush();
 private:
     QWebSocketServer *m_server_ws;
-    QList<QWebSocket*> m_client_ws;
+    QTcpServer *m_server_ws_raw;
+    QList<quint64> m_pending_ws;
+    QTimer *m_flush_ws;
+    int m_ws_deflate;
+private:
+    qint64 sendWs(RpcConnection*, QByteArray);
+    bool flushWs(RpcConnection*);
 
 private:
     bool m_logging;
@@ -45,6 +81,21 @@ public:
     bool getLogging() { return m_logging; }
     void setLogging(bool value) { m_logging = value; }
 
+private:
+    RpcExecutor *m_executor;
+public:
+    RpcExecutor *getExecutor() { return m_executor; }
+private:
+    void track(RpcConnection*, RpcTask*, const RpcHeader&);
+    void cancel(RpcConnection*, quint32);
+    void cancelAll(RpcConnection*);
+
+private:
+    RpcCapture *m_capture;
+public:
+    RpcCapture *getCapture() { return m_capture; }
+    void setCapture(RpcCapture *value) { m_capture = value; }
+
 private:
     QByteArray PutHttpHeaders(QByteArray);
     QByteArray GetHttpBody(QByteArray);
@@ -16,20 +16,60 @@ TEMPLATE = app
 SOURCES += main.cpp \
     protocol/api.pb.cc \
     protocol/calculator.pb.cc \
+    protocol/listener.pb.cc \
     protocol/reflector.pb.cc \
     protocol/rpc.pb.cc \
     rpc-server.cpp \
     rpc-task.cpp \
-    rpc-http.cpp
+    rpc-http.cpp \
+    rpc-delimited.cpp \
+    rpc-websocket.cpp \
+    rpc-registry.cpp \
+    rpc-wheel.cpp \
+    rpc-histogram.cpp \
+    rpc-metrics.cpp \
+    rpc-admin.cpp \
+    rpc-trace.cpp \
+    rpc-log.cpp \
+    rpc-capture.cpp \
+    rpc-executor.cpp \
+    rpc-perf.cpp \
+    rpc-batch.cpp \
+    rpc-pipeline.cpp \
+    rpc-vector.cpp \
+    rpc-eval.cpp \
+    rpc-memo.cpp \
+    rpc-flight.cpp
 
 HEADERS += \
     protocol/api.pb.h \
     protocol/calculator.pb.h \
+    protocol/listener.pb.h \
     protocol/reflector.pb.h \
     protocol/rpc.pb.h \
     rpc-task.h \
     rpc-server.h \
-    rpc-http.h
+    rpc-http.h \
+    rpc-delimited.h \
+    rpc-websocket.h \
+    rpc-registry.h \
+    rpc-wheel.h \
+    rpc-histogram.h \
+    rpc-metrics.h \
+    rpc-admin.h \
+    rpc-trace.h \
+    rpc-log.h \
+    rpc-capture.h \
+    rpc-executor.h \
+    rpc-perf.h \
+    rpc-usdt.h \
+    rpc-batch.h \
+    rpc-pipeline.h \
+    rpc-vector.h \
+    rpc-eval.h \
+    rpc-memo.h \
+    rpc-flight.h \
+    rpc-hash.h
 
 INCLUDEPATH += /usr/include
-LIBS += -L/usr/lib/ -lprotobuf -pthread  -lpthread
+LIBS += -L/usr/lib/ -lprotobuf -lz -pthread  -lpthread
@@ -1,18 +1,72 @@
 #include "rpc-task.h"
+#include "rpc-batch.h"
+#include "rpc-pipeline.h"
+#include "rpc-vector.h"
+#include "rpc-memo.h"
+#include "rpc-flight.h"
+#include "rpc-metrics.h"
+#include "rpc-trace.h"
+#include "rpc-perf.h"
+#include "rpc-usdt.h"
 
 #include <QtCore/QByteArray>
 #include <QtCore/QDebug>
 #include <QtCore/QObject>
 #include <QtCore/QRunnable>
 
-RpcTask::RpcTask(QByteArray bytes, void *socket, QObject *parent)
-    : m_bytes(bytes), m_socket(socket) {
+#include <cstring>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+// Rpc.Request: string name = 1, fixed32 id = 2, uint32 timeout = 5, Priority priority = 6
+#define RPC_REQUEST_NAME_TAG 0x0a
+#define RPC_REQUEST_ID_TAG 0x15
+#define RPC_REQUEST_TIMEOUT_TAG 0x28
+#define RPC_REQUEST_PRIORITY_TAG 0x30
+#define RPC_CANCEL_NAME ".Rpc.Cancel"
+// Rpc.Response: fixed32 id = 2 (serialized first, as the lowest field)
+#define RPC_RESPONSE_ID_TAG 0x15
+
+RpcTask::RpcTask(QByteArray bytes, quint64 client, quint64 trace, QObject *parent)
+    : m_bytes(bytes), m_client(client), m_deadline(0), m_executor(NULL), m_nested(false),
+      m_boarded(false) {
+    if (RpcMetrics::enabled()) {
+        m_stamp.queued = RpcMetrics::now();
+    }
+    if (trace) {
+        m_stamp.trace = trace;
+        RpcTrace::mark(RpcTrace::Queued, m_client, trace);
+    }
 }
 
 void RpcTask::run() {
-    QByteArray bytes = process(m_bytes);
-    Q_ASSERT(bytes.length() > 0);
-    emit result(bytes, m_socket);
+    RPC_PROBE4(task__start, m_client, m_header.id, m_header.name.constData(), m_bytes.length());
+    qint64 started = m_stamp.queued ? RpcMetrics::now() : 0;
+    if (m_stamp.trace) {
+        RpcTrace::mark(RpcTrace::Start, m_client, m_stamp.trace);
+    }
+
+    QByteArray bytes;
+    bool expired = m_deadline && RpcMetrics::now() > m_deadline;
+    try {
+        bytes = expired ? expire() : process(m_bytes);
+    } catch (RpcException &ex) {
+        qWarning() << "[on:error]" << ex.m_message;
+    }
+
+    if (m_stamp.queued) {
+        RpcMetrics::instance()->record(
+                    m_stamp.method, quint64(m_bytes.length()),
+                    started - m_stamp.queued, RpcMetrics::now() - started,
+                    (bytes.isEmpty() && !m_boarded) || expired);
+    }
+    if (!bytes.isEmpty() && !(m_token && m_token->cancelled())) {
+        emit result(bytes, m_client, m_stamp);
+    }
 }
 
 QByteArray RpcTask::process(QByteArray req_msg) {
@@ -20,8 +74,49 @@ QByteArray RpcTask::process(QByteArray req_msg) {
     Q_ASSERT(req_data);
     int req_size = req_msg.length();
     Q_ASSERT(req_size);
+    RPC_PROBE4(process__entry, m_client, m_header.id, m_header.name.constData(), req_size);
     bool req_parsed = m_req.ParseFromArray(req_data, req_size);
     Q_ASSERT(req_parsed);
+    m_stamp.method = QByteArray::fromStdString(m_req.name());
+    if (m_stamp.trace) {
+        RpcTrace::mark(RpcTrace::Parsed, m_client, m_stamp.trace);
+    }
+
+    //
+    // Shared responses are re-stamped in place, which needs an id to be
+    // serialized, i.e. requests of id 0 are neither memoized nor coalesced:
+    //
+
+    bool memo = m_req.id() != 0 && RpcMemo::instance()->memoizes(m_req.name());
+    if (memo) {
+        QByteArray res_msg = RpcMemo::instance()->lookup(m_req.name(), m_req.data());
+        if (!res_msg.isEmpty()) {
+            return restamp(res_msg);
+        }
+    }
+
+    //
+    // A boarded request is answered by the flight's leader, i.e. it returns
+    // no response of its own (and chunks of batches do not coalesce, since
+    // their responses are not sent to a client):
+    //
+
+    RpcFlight::Ticket ticket;
+    m_boarded = false;
+    if (!m_nested && m_req.id() != 0 && RpcFlight::instance()->coalesces(m_req.name())) {
+        RpcFlight::Passenger passenger;
+        passenger.client = m_client;
+        passenger.stamp = m_stamp;
+        passenger.stamp.id = m_req.id();
+        passenger.token = m_token;
+        if (RpcFlight::instance()->board(m_req.name(), m_req.data(), &ticket, passenger)) {
+            m_boarded = true;
+            return QByteArray();
+        }
+    }
+
+    RpcPerfSample perf_before;
+    bool perf = RpcPerf::enabled() && RpcPerf::read(&perf_before);
 
     if (m_req.name() == ".Reflector.Service.ack") {
         bool ack_parsed = m_ack_req.ParseFromString(m_req.data());
@@ -51,20 +146,181 @@ QByteArray RpcTask::process(QByteArray req_msg) {
         bool mul_parsed = m_div_req.ParseFromString(m_req.data());
         Q_ASSERT(mul_parsed);
 
+        if (m_div_req.rhs() == 0) {
+            throw RpcException(QString(m_req.name().c_str()).append(": division by zero"));
+        }
         m_div_res.set_value(m_div_req.lhs() / m_div_req.rhs());
         m_res.set_data(m_div_res.SerializeAsString());
+    } else if (m_req.name() == ".Calculator.Service.eval") {
+        m_res.set_data(m_eval.process(m_req.data()));
+    } else if (RpcVector::Op op = RpcVector::op(m_req.name())) {
+        if (!m_vector.parse(m_req.data())) {
+            throw RpcException(QString(m_req.name().c_str()).append(": operands mismatch"));
+        }
+        if (op == RpcVector::Division && m_vector.hasZero()) {
+            throw RpcException(QString(m_req.name().c_str()).append(": division by zero"));
+        }
+        m_res.set_data(m_vector.compute(op));
+    } else if (m_req.name() == ".Rpc.Batch") {
+        if (m_nested) {
+            throw RpcException(QString(m_req.name().c_str()).append(": nested batch"));
+        }
+        RpcBatch batch(m_executor, m_client);
+        batch.setToken(m_token.data());
+        m_res.set_data(batch.process(m_req.data()).toStdString());
+    } else if (m_req.name() == ".Rpc.Pipeline") {
+        if (m_nested) {
+            throw RpcException(QString(m_req.name().c_str()).append(": nested pipeline"));
+        }
+        RpcPipeline pipeline(m_executor, m_client);
+        pipeline.setToken(m_token.data());
+        m_res.set_data(pipeline.process(m_req.data()).toStdString());
     } else {
+        m_stamp.method = QByteArrayLiteral("unsupported");
         throw RpcException(QString(m_req.name().c_str()).append(": not supported"));
     }
 
+    RpcPerfSample perf_after;
+    if (perf && RpcPerf::read(&perf_after)) {
+        RpcMetrics::instance()->recordPerf(m_stamp.method, perf_after - perf_before);
+    }
+    if (m_stamp.trace) {
+        RpcTrace::mark(RpcTrace::Handled, m_client, m_stamp.trace);
+    }
+
     m_res.set_id(m_req.id());
     Q_ASSERT(m_res.id() > 0);
+    m_stamp.id = m_req.id();
     int res_size = m_res.ByteSize();
     Q_ASSERT(res_size);
     QByteArray res_msg(res_size, 0);
     Q_ASSERT(res_msg.capacity() == res_size);
     m_res.SerializeToArray(res_msg.data(), res_size);
     Q_ASSERT(res_msg.size() == res_size);
+    if (m_stamp.trace) {
+        RpcTrace::mark(RpcTrace::Serialized, m_client, m_stamp.trace);
+    }
+    if (memo) {
+        RpcMemo::instance()->insert(m_req.name(), m_req.data(), res_msg);
+    }
+    foreach (const RpcFlight::Passenger &passenger, ticket.land(res_msg)) {
+        if (passenger.token && passenger.token->cancelled()) {
+            continue;
+        }
+        QByteArray bytes = Restamp(res_msg, passenger.stamp.id);
+        Q_ASSERT(!bytes.isEmpty());
+        if (passenger.stamp.trace) {
+            RpcTrace::mark(RpcTrace::Serialized, passenger.client, passenger.stamp.trace);
+        }
+        RPC_PROBE4(process__return, passenger.client, passenger.stamp.id, m_req.name().c_str(), bytes.size());
+        emit result(bytes, passenger.client, passenger.stamp);
+    }
+    RPC_PROBE4(process__return, m_client, m_stamp.id, m_req.name().c_str(), res_size);
+
+    return res_msg;
+}
+
+QByteArray RpcTask::restamp(QByteArray res_msg) {
+    m_stamp.id = m_req.id();
+    res_msg = Restamp(res_msg, m_stamp.id);
+    if (res_msg.isEmpty()) {
+        throw RpcException(QString(m_req.name().c_str()).append(": invalid shared response"));
+    }
+    if (m_stamp.trace) {
+        RpcTrace::mark(RpcTrace::Serialized, m_client, m_stamp.trace);
+    }
+    RPC_PROBE4(process__return, m_client, m_stamp.id, m_req.name().c_str(), res_msg.size());
+    return res_msg;
+}
+
+//
+// Writes the id into a serialized response, which starts with it (as the
+// lowest field) unless the response's id was 0 and hence omitted: Then the
+// response is re-serialized (or an empty one returned if invalid).
+//
+
+QByteArray RpcTask::Restamp(QByteArray res_msg, quint32 id) {
+    if (res_msg.size() > 5 && quint8(res_msg.at(0)) == RPC_RESPONSE_ID_TAG) {
+        char *bytes = res_msg.data() + 1; // detaches
+        for (int i = 0; i < 4; i++) {
+            bytes[i] = char(quint8(id >> (8 * i)));
+        }
+        return res_msg;
+    }
+    Rpc_Response response;
+    if (!response.ParseFromArray(res_msg.constData(), res_msg.size())) {
+        return QByteArray();
+    }
+    response.set_id(id);
+    return QByteArray::fromStdString(response.SerializeAsString());
+}
 
+//
+// Answers a request which waited past its deadline without parsing it: The
+// id is scanned for (skipping the payload), and the response holds a status
+// only. Expired requests are counted as failures of the `expired` method.
+//
+
+QByteArray RpcTask::expire() {
+    RpcHeader header;
+    bool peeked = Peek(m_bytes, &header);
+    Q_ASSERT(peeked);
+    m_stamp.method = QByteArrayLiteral("expired");
+    m_stamp.id = header.id;
+    RPC_PROBE2(task__expired, m_client, header.id);
+
+    m_res.Clear();
+    m_res.set_id(header.id);
+    m_res.set_status(Rpc_Response::DEADLINE_EXCEEDED);
+    int res_size = m_res.ByteSize();
+    QByteArray res_msg(res_size, 0);
+    m_res.SerializeToArray(res_msg.data(), res_size);
     return res_msg;
 }
+
+bool RpcTask::Peek(const QByteArray &req_msg, RpcHeader *header) {
+    Q_ASSERT(header);
+    CodedInputStream input(
+                reinterpret_cast<const quint8*>(req_msg.constData()), req_msg.size());
+
+    while (quint32 tag = input.ReadTag()) {
+        switch (tag) {
+        case RPC_REQUEST_NAME_TAG: {
+            quint32 length;
+            if (!input.ReadVarint32(&length)) {
+                return false;
+            }
+            const void *name;
+            int size;
+            if (input.GetDirectBufferPointer(&name, &size) && size >= int(length)) {
+                header->name = QByteArray(static_cast<const char*>(name), int(length));
+            }
+            header->cancel = header->name == RPC_CANCEL_NAME;
+            if (!input.Skip(int(length))) {
+                return false;
+            }
+            break;
+        }
+        case RPC_REQUEST_ID_TAG:
+            if (!input.ReadLittleEndian32(&header->id)) {
+                return false;
+            }
+            break;
+        case RPC_REQUEST_TIMEOUT_TAG:
+            if (!input.ReadVarint32(&header->timeout)) {
+                return false;
+            }
+            break;
+        case RPC_REQUEST_PRIORITY_TAG:
+            if (!input.ReadVarint32(&header->priority)) {
+                return false;
+            }
+            break;
+        default:
+            if (!WireFormatLite::SkipField(&input, tag)) {
+                return false;
+            }
+        }
+    }
+    return input.ConsumedEntireMessage();
+}
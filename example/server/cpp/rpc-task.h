@@ -5,25 +5,104 @@
 #include <QtCore/QException>
 #include <QtCore/QObject>
 #include <QtCore/QRunnable>
+#include <QtCore/QSharedPointer>
 
 #include "protocol/rpc.pb.h"
 #include "protocol/api.pb.h"
+#include "rpc-eval.h"
+#include "rpc-executor.h"
+#include "rpc-vector.h"
+
+//
+// Bookkeeping travelling with a request from the I/O thread to a worker and
+// back: the method and request id (once known), the enqueue time (if metrics
+// are enabled) and the trace id (if tracing is enabled).
+//
+
+struct RpcStamp
+{
+    RpcStamp() : id(0), queued(0), trace(0) {}
+
+    QByteArray method;
+    quint32 id;
+    qint64 queued;
+    quint64 trace;
+};
+
+Q_DECLARE_METATYPE(RpcStamp)
+
+//
+// Envelope fields the I/O thread needs before queueing a request, scanned
+// for by `RpcTask::Peek` without parsing (or copying) the request's data.
+//
+
+struct RpcHeader
+{
+    RpcHeader() : id(0), timeout(0), priority(0), cancel(false) {}
+
+    QByteArray name; // copied, i.e. NUL terminated (for the probes)
+    quint32 id;
+    quint32 timeout;
+    quint32 priority; // Rpc.Request.Priority
+    bool cancel; // named `.Rpc.Cancel`
+};
 
 class RpcTask : public QObject, public QRunnable
 {
     Q_OBJECT
 public:
-    explicit RpcTask(QByteArray bytes, void *socket = NULL, QObject *parent = 0);
+    explicit RpcTask(QByteArray bytes, quint64 client = 0, quint64 trace = 0, QObject *parent = 0);
 
 signals:
-    void result(QByteArray bytes, void *socket = NULL);
+    void result(QByteArray bytes, quint64 client = 0, RpcStamp stamp = RpcStamp());
 
 protected:
     void run();
+public:
+    QByteArray process(QByteArray);
+    static bool Peek(const QByteArray &req_msg, RpcHeader *header);
+    static QByteArray Restamp(QByteArray res_msg, quint32 id);
+private:
+    QByteArray restamp(QByteArray res_msg);
+    QByteArray expire();
 
 private:
     QByteArray m_bytes;
-    void *m_socket;
+    quint64 m_client;
+    RpcStamp m_stamp;
+
+private:
+    qint64 m_deadline; // [ns] of RpcMetrics::now, 0 for none
+public:
+    qint64 getDeadline() { return m_deadline; }
+    void setDeadline(qint64 value) { m_deadline = value; }
+
+private:
+    RpcHeader m_header; // as peeked by the I/O thread
+public:
+    const RpcHeader &getHeader() { return m_header; }
+    void setHeader(const RpcHeader &value) { m_header = value; }
+
+private:
+    RpcExecutor *m_executor; // for the chunks of batches, if any
+public:
+    RpcExecutor *getExecutor() { return m_executor; }
+    void setExecutor(RpcExecutor *value) { m_executor = value; }
+
+private:
+    QSharedPointer<RpcToken> m_token;
+public:
+    QSharedPointer<RpcToken> getToken() { return m_token; }
+    void setToken(QSharedPointer<RpcToken> value) { m_token = value; }
+
+private:
+    bool m_nested;
+public:
+    bool getNested() { return m_nested; }
+    void setNested(bool value) { m_nested = value; }
+
+private:
+    bool m_boarded; // i.e. answered by the leader of a flight
 
 private:
     Rpc_Request m_req;
@@ -40,9 +119,8 @@ private:
     Calculator::MulResult m_mul_res;
     Calculator::DivRequest m_div_req;
     Calculator::DivResult m_div_res;
-
-private:
-    QByteArray process(QByteArray);
+    RpcVector m_vector;
+    RpcEval m_eval;
 };
 
 class RpcException : public QException
@@ -0,0 +1,189 @@
+#include "rpc-trace.h"
+#include "rpc-metrics.h"
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QVector>
+
+#include <algorithm>
+
+#define RPC_TRACE_RING (1 << 14)
+
+bool RpcTrace::s_enabled = false;
+
+namespace {
+    const char *STAGES[] = {
+        "accept", "read", "framed", "queued", "start",
+        "parsed", "handled", "serialized", "delivered", "written"
+    };
+
+    struct RpcTraceEvent {
+        qint64 ts;
+        quint64 connection;
+        quint64 trace;
+        int stage;
+        int tid;
+    };
+
+    struct RpcTraceRing {
+        RpcTraceRing(int tid, QString name)
+            : tid(tid), name(name), head(0), events(RPC_TRACE_RING) {}
+        int tid;
+        QString name;
+        QAtomicInteger<quint64> head;
+        QVector<RpcTraceEvent> events;
+    };
+
+    //
+    // Rings are never freed: Once their thread finishes they are handed on
+    // to the next new thread, which bounds their number by the peak number
+    // of concurrent threads.
+    //
+
+    QMutex g_mutex;
+    QList<RpcTraceRing*> g_rings;
+    QList<RpcTraceRing*> g_free;
+    QAtomicInteger<quint64> g_next(0);
+
+    struct RpcTraceHolder {
+        RpcTraceHolder(RpcTraceRing *ring) : ring(ring) {}
+        ~RpcTraceHolder() {
+            QMutexLocker locker(&g_mutex);
+            g_free << ring;
+        }
+        RpcTraceRing *ring;
+    };
+
+    QThreadStorage<RpcTraceHolder*> g_holders;
+
+    RpcTraceRing *local() {
+        if (!g_holders.hasLocalData()) {
+            QCoreApplication *app = QCoreApplication::instance();
+            QString name = app && app->thread() == QThread::currentThread()
+                    ? QStringLiteral("io") : QStringLiteral("worker");
+
+            QMutexLocker locker(&g_mutex);
+            RpcTraceRing *ring = g_free.isEmpty() ? NULL : g_free.takeLast();
+            if (ring == NULL) {
+                ring = new RpcTraceRing(g_rings.length() + 1, name);
+                Q_ASSERT(ring);
+                g_rings << ring;
+            } else {
+                ring->name = name;
+            }
+            g_holders.setLocalData(new RpcTraceHolder(ring));
+        }
+        return g_holders.localData()->ring;
+    }
+
+    bool lessThan(const RpcTraceEvent &lhs, const RpcTraceEvent &rhs) {
+        return lhs.ts < rhs.ts;
+    }
+}
+
+quint64 RpcTrace::next() {
+    return g_next.fetchAndAddRelaxed(1) + 1;
+}
+
+void RpcTrace::mark(Stage stage, quint64 connection, quint64 trace) {
+    RpcTraceRing *ring = local();
+    quint64 head = ring->head.load();
+
+    RpcTraceEvent &event = ring->events[int(head & (RPC_TRACE_RING - 1))];
+    event.ts = RpcMetrics::now();
+    event.connection = connection;
+    event.trace = trace;
+    event.stage = int(stage);
+    event.tid = ring->tid;
+
+    ring->head.storeRelease(head + 1);
+}
+
+QByteArray RpcTrace::chrome() {
+    QJsonArray json;
+    QList<RpcTraceEvent> events;
+    {
+        QMutexLocker locker(&g_mutex);
+        foreach(RpcTraceRing *ring, g_rings) {
+            QJsonObject meta, args;
+            args["name"] = QString("%1-%2").arg(ring->name).arg(ring->tid);
+            meta["ph"] = "M";
+            meta["name"] = "thread_name";
+            meta["pid"] = 1;
+            meta["tid"] = ring->tid;
+            meta["args"] = args;
+            json << meta;
+
+            //
+            // The owner keeps writing while the ring is copied: Events which
+            // may have been overwritten in the meantime are dropped.
+            //
+
+            quint64 head = ring->head.loadAcquire();
+            quint64 tail = head > RPC_TRACE_RING ? head - RPC_TRACE_RING : 0;
+            QList<RpcTraceEvent> copy;
+            for (quint64 i = tail; i < head; i++) {
+                copy << ring->events.at(int(i & (RPC_TRACE_RING - 1)));
+            }
+            quint64 done = ring->head.loadAcquire();
+            int torn = int(qMin(done > RPC_TRACE_RING
+                                ? done - RPC_TRACE_RING - tail : 0, quint64(copy.length())));
+            events << copy.mid(torn);
+        }
+    }
+
+    QMap<quint64, QList<RpcTraceEvent> > requests;
+    foreach(const RpcTraceEvent &event, events) {
+        if (event.trace) {
+            requests[event.trace] << event;
+            continue;
+        }
+        QJsonObject instant, args;
+        args["connection"] = QString::number(event.connection);
+        instant["ph"] = "i";
+        instant["s"] = "t";
+        instant["name"] = STAGES[event.stage];
+        instant["ts"] = event.ts / 1000.0;
+        instant["pid"] = 1;
+        instant["tid"] = event.tid;
+        instant["args"] = args;
+        json << instant;
+    }
+
+    QMap<quint64, QList<RpcTraceEvent> >::iterator it;
+    for (it = requests.begin(); it != requests.end(); ++it) {
+        QList<RpcTraceEvent> &stages = it.value();
+        std::stable_sort(stages.begin(), stages.end(), lessThan);
+
+        for (int i = 0; i + 1 < stages.length(); i++) {
+            const RpcTraceEvent &lhs = stages[i], &rhs = stages[i + 1];
+            QJsonObject span, args;
+            args["connection"] = QString::number(lhs.connection);
+            args["request"] = QString::number(it.key());
+            args["until"] = STAGES[rhs.stage];
+            span["ph"] = "X";
+            span["name"] = STAGES[lhs.stage];
+            span["cat"] = "rpc";
+            span["ts"] = lhs.ts / 1000.0;
+            span["dur"] = (rhs.ts - lhs.ts) / 1000.0;
+            span["pid"] = 1;
+            span["tid"] = lhs.tid;
+            span["args"] = args;
+            json << span;
+        }
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = json;
+    trace["displayTimeUnit"] = "ns";
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
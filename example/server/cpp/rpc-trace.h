@@ -0,0 +1,33 @@
+#ifndef RPC_TRACE_H
+#define RPC_TRACE_H
+
+#include <QtCore/QByteArray>
+
+//
+// Per stage timestamps of requests: Each thread appends its events to an
+// own fixed size ring (single producer, no locks), overwriting the oldest
+// ones. A dump copies the rings and emits the events as Chrome trace_event
+// JSON, where the time between two stages of a request becomes a span on
+// the thread which recorded the earlier stage.
+//
+
+class RpcTrace
+{
+public:
+    enum Stage {
+        Accept, Read, Framed, Queued, Start,
+        Parsed, Handled, Serialized, Delivered, Written
+    };
+
+    static bool enabled() { return s_enabled; }
+    static void setEnabled(bool value) { s_enabled = value; }
+
+    static quint64 next();
+    static void mark(Stage stage, quint64 connection, quint64 trace = 0);
+    static QByteArray chrome();
+
+private:
+    static bool s_enabled;
+};
+
+#endif // RPC_TRACE_H
@@ -0,0 +1,29 @@
+#ifndef RPC_USDT_H
+#define RPC_USDT_H
+
+//
+// USDT (SystemTap compatible) static probes of the `rpc` provider, to be
+// attached to with e.g. bpftrace or perf. An unattached probe is a single
+// `nop` (plus an ELF note), its arguments are only loaded into registers.
+// Without <sys/sdt.h> (from systemtap-sdt-dev), or if RPC_NO_USDT is
+// defined, the probes compile to nothing.
+//
+
+#if !defined(RPC_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define RPC_USDT 1
+#endif
+#endif
+
+#ifdef RPC_USDT
+#define RPC_PROBE2(name, a1, a2) \
+    DTRACE_PROBE2(rpc, name, a1, a2)
+#define RPC_PROBE4(name, a1, a2, a3, a4) \
+    DTRACE_PROBE4(rpc, name, a1, a2, a3, a4)
+#else
+#define RPC_PROBE2(name, a1, a2)
+#define RPC_PROBE4(name, a1, a2, a3, a4)
+#endif
+
+#endif // RPC_USDT_H
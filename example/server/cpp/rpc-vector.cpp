@@ -0,0 +1,701 @@
+#include "rpc-vector.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RPC_VECTOR_X86
+#endif
+
+#define RPC_VECTOR_ALIGNMENT 32
+
+RpcVector::Op RpcVector::op(const std::string &name) {
+    if (name == ".Calculator.Service.addBatch") {
+        return Addition;
+    } else if (name == ".Calculator.Service.subBatch") {
+        return Subtraction;
+    } else if (name == ".Calculator.Service.mulBatch") {
+        return Multiplication;
+    } else if (name == ".Calculator.Service.divBatch") {
+        return Division;
+    }
+    return None;
+}
+
+RpcVector::RpcVector() {
+}
+
+RpcVector::~RpcVector() {
+    qFreeAligned(m_lhs.data);
+    qFreeAligned(m_rhs.data);
+    qFreeAligned(m_out.data);
+}
+
+void RpcVector::Buffer::reserve(int size) {
+    if (size <= capacity) {
+        return;
+    }
+    int new_capacity = qMax(size, 2 * capacity);
+    data = static_cast<qint32*>(qReallocAligned(
+                data, size_t(new_capacity) * sizeof(qint32),
+                size_t(capacity) * sizeof(qint32), RPC_VECTOR_ALIGNMENT));
+    Q_ASSERT(data);
+    capacity = new_capacity;
+}
+
+namespace {
+    inline const quint8 *ReadVarint(const quint8 *data, const quint8 *end, quint64 *value) {
+        quint64 result = 0;
+        for (int shift = 0; shift < 70 && data < end; shift += 7) {
+            quint8 byte = *data++;
+            result |= quint64(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                *value = result;
+                return data;
+            }
+        }
+        return NULL;
+    }
+
+    inline quint8 *WriteVarint(quint64 value, quint8 *out) {
+        while (value >= 0x80) {
+            *out++ = quint8(value | 0x80);
+            value >>= 7;
+        }
+        *out++ = quint8(value);
+        return out;
+    }
+}
+
+//
+// Masked VByte style tables: For decoding, indexed by the continuation bits
+// of 12 input bytes, the shuffle moving the bytes of (up to) four complete
+// varints of at most 4 bytes each into the lanes of a 128 bit register; for
+// encoding, indexed by the byte lengths (minus one) of four values, or by
+// which of eight values below 2^14 take two bytes, the shuffle compacting
+// the lanes into consecutive varints.
+//
+
+#ifdef RPC_VECTOR_X86
+namespace {
+    struct RpcVarintTables {
+        struct Entry {
+            quint8 shuffle[16];
+            quint8 count;
+            quint8 bytes;
+        };
+        Entry decode[1 << 12];
+        Entry encode[1 << 8];
+        Entry encode2[1 << 8];
+
+        RpcVarintTables() {
+            for (int mask = 0; mask < (1 << 12); mask++) {
+                Entry &entry = decode[mask];
+                memset(entry.shuffle, 0x80, sizeof(entry.shuffle));
+                int offset = 0, count = 0;
+                while (count < 4) {
+                    int length = 1;
+                    while (offset + length - 1 < 12 && (mask >> (offset + length - 1)) & 1) {
+                        length++;
+                    }
+                    if (offset + length - 1 >= 12 || length > 4) {
+                        break;
+                    }
+                    for (int k = 0; k < length; k++) {
+                        entry.shuffle[4 * count + k] = quint8(offset + k);
+                    }
+                    offset += length;
+                    count += 1;
+                }
+                entry.count = quint8(count);
+                entry.bytes = quint8(offset);
+            }
+            for (int index = 0; index < (1 << 8); index++) {
+                Entry &entry = encode[index];
+                memset(entry.shuffle, 0x80, sizeof(entry.shuffle));
+                int offset = 0;
+                for (int lane = 0; lane < 4; lane++) {
+                    int length = 1 + ((index >> (2 * lane)) & 3);
+                    for (int k = 0; k < length; k++) {
+                        entry.shuffle[offset++] = quint8(4 * lane + k);
+                    }
+                }
+                entry.count = 4;
+                entry.bytes = quint8(offset);
+            }
+            for (int mask = 0; mask < (1 << 8); mask++) {
+                Entry &entry = encode2[mask];
+                memset(entry.shuffle, 0x80, sizeof(entry.shuffle));
+                int offset = 0;
+                for (int lane = 0; lane < 8; lane++) {
+                    entry.shuffle[offset++] = quint8(2 * lane);
+                    if ((mask >> lane) & 1) {
+                        entry.shuffle[offset++] = quint8(2 * lane + 1);
+                    }
+                }
+                entry.count = 8;
+                entry.bytes = quint8(offset);
+            }
+        }
+    };
+
+    const RpcVarintTables &Tables() {
+        static const RpcVarintTables tables;
+        return tables;
+    }
+}
+
+__attribute__((target("sse4.1")))
+static const quint8 *DecodeSse4(const quint8 *data, const quint8 *end, qint32 *out, int *length) {
+    const RpcVarintTables &tables = Tables();
+    const __m128i low7 = _mm_set1_epi32(0x7f7f7f7f);
+    int n = 0;
+
+    while (end - data >= 16) {
+        __m128i input = _mm_loadu_si128((const __m128i*)data);
+        int mask = _mm_movemask_epi8(input);
+
+        if (mask == 0) {
+            _mm_storeu_si128((__m128i*)(out + n), _mm_cvtepu8_epi32(input));
+            _mm_storeu_si128((__m128i*)(out + n + 4), _mm_cvtepu8_epi32(_mm_srli_si128(input, 4)));
+            _mm_storeu_si128((__m128i*)(out + n + 8), _mm_cvtepu8_epi32(_mm_srli_si128(input, 8)));
+            _mm_storeu_si128((__m128i*)(out + n + 12), _mm_cvtepu8_epi32(_mm_srli_si128(input, 12)));
+            data += 16;
+            n += 16;
+            continue;
+        }
+
+        if (mask == 0x5555) {
+            __m128i x = _mm_and_si128(input, _mm_set1_epi16(0x7f7f));
+            __m128i v = _mm_or_si128( // 8 values of 2 bytes
+                        _mm_and_si128(x, _mm_set1_epi16(0x7f)),
+                        _mm_and_si128(_mm_srli_epi16(x, 1), _mm_set1_epi16(0x3f80)));
+            _mm_storeu_si128((__m128i*)(out + n), _mm_cvtepu16_epi32(v));
+            _mm_storeu_si128((__m128i*)(out + n + 4), _mm_cvtepu16_epi32(_mm_srli_si128(v, 8)));
+            data += 16;
+            n += 8;
+            continue;
+        }
+
+        const RpcVarintTables::Entry &entry = tables.decode[mask & 0xfff];
+        if (entry.count == 0) {
+            quint64 value; // longer than 4 bytes
+            data = ReadVarint(data, end, &value);
+            if (!data) {
+                return NULL;
+            }
+            out[n++] = qint32(quint32(value));
+            continue;
+        }
+
+        __m128i x = _mm_and_si128(_mm_shuffle_epi8(
+                    input, _mm_loadu_si128((const __m128i*)entry.shuffle)), low7);
+        __m128i v = _mm_or_si128(
+                    _mm_or_si128(_mm_and_si128(x, _mm_set1_epi32(0x7f)),
+                                 _mm_and_si128(_mm_srli_epi32(x, 1), _mm_set1_epi32(0x3f80))),
+                    _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 2), _mm_set1_epi32(0x1fc000)),
+                                 _mm_and_si128(_mm_srli_epi32(x, 3), _mm_set1_epi32(0xfe00000))));
+        _mm_storeu_si128((__m128i*)(out + n), v);
+        data += entry.bytes;
+        n += entry.count;
+    }
+
+    int tail = 0;
+    data = RpcVector::DecodeScalar(data, end, out + n, &tail);
+    *length = n + tail;
+    return data;
+}
+
+__attribute__((target("sse4.1")))
+static quint8 *EncodeSse4(const qint32 *values, int length, quint8 *out) {
+    const RpcVarintTables &tables = Tables();
+    int i = 0;
+
+    for (; i + 4 <= length; i += 4) {
+        if (i + 16 <= length) {
+            __m128i v0 = _mm_loadu_si128((const __m128i*)(values + i));
+            __m128i v1 = _mm_loadu_si128((const __m128i*)(values + i + 4));
+            __m128i v2 = _mm_loadu_si128((const __m128i*)(values + i + 8));
+            __m128i v3 = _mm_loadu_si128((const __m128i*)(values + i + 12));
+            __m128i any = _mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3));
+            if (_mm_testz_si128(any, _mm_set1_epi32(~0x7f))) { // 16 values of 1 byte
+                _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(
+                                     _mm_packus_epi32(v0, v1), _mm_packus_epi32(v2, v3)));
+                out += 16;
+                i += 12;
+                continue;
+            }
+        }
+        if (i + 8 <= length) {
+            __m128i v0 = _mm_loadu_si128((const __m128i*)(values + i));
+            __m128i v1 = _mm_loadu_si128((const __m128i*)(values + i + 4));
+            __m128i any = _mm_or_si128(v0, v1);
+            if (_mm_testz_si128(any, _mm_set1_epi32(~0x3fff))) { // 8 values of 1-2 bytes
+                __m128i v = _mm_packus_epi32(v0, v1);
+                __m128i m = _mm_cmpgt_epi16(v, _mm_set1_epi16(0x7f));
+                __m128i x = _mm_or_si128(_mm_or_si128(
+                        _mm_and_si128(v, _mm_set1_epi16(0x7f)),
+                        _mm_and_si128(_mm_slli_epi16(v, 1), _mm_set1_epi16(0x7f00))),
+                        _mm_and_si128(m, _mm_set1_epi16(0x80)));
+                int mask = _mm_movemask_epi8(_mm_packs_epi16(m, m)) & 0xff;
+
+                const RpcVarintTables::Entry &entry = tables.encode2[mask];
+                _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(
+                                     x, _mm_loadu_si128((const __m128i*)entry.shuffle)));
+                out += entry.bytes;
+                i += 4;
+                continue;
+            }
+        }
+
+        __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+        __m128i m7 = _mm_cmpgt_epi32(v, _mm_set1_epi32((1 << 7) - 1));
+        __m128i m14 = _mm_cmpgt_epi32(v, _mm_set1_epi32((1 << 14) - 1));
+        __m128i m21 = _mm_cmpgt_epi32(v, _mm_set1_epi32((1 << 21) - 1));
+        __m128i m28 = _mm_cmpgt_epi32(v, _mm_set1_epi32((1 << 28) - 1));
+
+        // negative (10 bytes) or at least 2^28 (5 bytes):
+        if (_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(
+                v, m28))) != 0) {
+            for (int k = 0; k < 4; k++) {
+                out = WriteVarint(quint64(qint64(values[i + k])), out);
+            }
+            continue;
+        }
+
+        __m128i x = _mm_or_si128(
+                    _mm_or_si128(_mm_and_si128(v, _mm_set1_epi32(0x7f)),
+                                 _mm_and_si128(_mm_slli_epi32(v, 1), _mm_set1_epi32(0x7f00))),
+                    _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 2), _mm_set1_epi32(0x7f0000)),
+                                 _mm_and_si128(_mm_slli_epi32(v, 3), _mm_set1_epi32(0x7f000000))));
+        x = _mm_or_si128(x, _mm_or_si128(
+                             _mm_and_si128(m7, _mm_set1_epi32(0x80)),
+                             _mm_or_si128(_mm_and_si128(m14, _mm_set1_epi32(0x8000)),
+                                          _mm_and_si128(m21, _mm_set1_epi32(0x800000)))));
+
+        // lengths minus one in the bytes, then packed into 2 bits each:
+        __m128i lengths = _mm_sub_epi32(_mm_sub_epi32(_mm_sub_epi32(
+                _mm_setzero_si128(), m7), m14), m21);
+        lengths = _mm_packus_epi16(_mm_packus_epi32(lengths, lengths), lengths);
+        quint32 word = quint32(_mm_cvtsi128_si32(lengths));
+        quint32 index = (word | (word >> 6) | (word >> 12) | (word >> 18)) & 0xff;
+
+        const RpcVarintTables::Entry &entry = tables.encode[index];
+        _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(
+                             x, _mm_loadu_si128((const __m128i*)entry.shuffle)));
+        out += entry.bytes;
+    }
+    return RpcVector::EncodeScalar(values + i, length - i, out);
+}
+
+static const bool g_ssse3 = __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.1");
+#endif
+
+//
+// Decodes the varints of a packed int32 field into `out`, which must have
+// room for `end - data` plus 16 values (each value taking one byte at least,
+// plus the slack of the vector stores).
+//
+
+const quint8 *RpcVector::Decode(const quint8 *data, const quint8 *end, qint32 *out, int *length) {
+#ifdef RPC_VECTOR_X86
+    if (g_ssse3) {
+        return DecodeSse4(data, end, out, length);
+    }
+#endif
+    return DecodeScalar(data, end, out, length);
+}
+
+const quint8 *RpcVector::DecodeScalar(const quint8 *data, const quint8 *end, qint32 *out, int *length) {
+    int n = 0;
+    while (data < end) {
+        quint64 value;
+        data = ReadVarint(data, end, &value);
+        if (!data) {
+            return NULL;
+        }
+        out[n++] = qint32(quint32(value));
+    }
+    *length = n;
+    return data;
+}
+
+//
+// Encodes the values as varints (negative ones sign extended to 10 bytes)
+// into `out`, which must have room for `EncodedSize` plus 16 bytes.
+//
+
+quint8 *RpcVector::Encode(const qint32 *values, int length, quint8 *out) {
+#ifdef RPC_VECTOR_X86
+    if (g_ssse3) {
+        return EncodeSse4(values, length, out);
+    }
+#endif
+    return EncodeScalar(values, length, out);
+}
+
+quint8 *RpcVector::EncodeScalar(const qint32 *values, int length, quint8 *out) {
+    for (int i = 0; i < length; i++) {
+        out = WriteVarint(quint64(qint64(values[i])), out);
+    }
+    return out;
+}
+
+size_t RpcVector::EncodedSize(const qint32 *values, int length) {
+    size_t size = 0;
+    for (int i = 0; i < length; i++) {
+        quint32 value = quint32(values[i]);
+        size += values[i] < 0 ? 10 : value < (1u << 7) ? 1 : value < (1u << 14) ? 2
+                : value < (1u << 21) ? 3 : value < (1u << 28) ? 4 : 5;
+    }
+    return size;
+}
+
+std::string RpcVector::Serialize(quint32 field, const qint32 *values, int length) {
+    size_t size = EncodedSize(values, length);
+    if (size == 0) {
+        return std::string();
+    }
+
+    std::string result;
+    result.resize(1 + 5 + size + 16);
+    quint8 *data = reinterpret_cast<quint8*>(&result[0]);
+    quint8 *head = data;
+
+    *head++ = quint8((field << 3) | 2);
+    head = WriteVarint(size, head);
+    head = Encode(values, length, head);
+    Q_ASSERT(head <= data + 1 + 5 + size);
+
+    result.resize(size_t(head - data));
+    return result;
+}
+
+bool RpcVector::parse(const std::string &data) {
+    const quint8 *head = reinterpret_cast<const quint8*>(data.data());
+    const quint8 *end = head + data.size();
+    m_lhs.length = m_rhs.length = 0;
+
+    while (head < end) {
+        quint64 tag;
+        head = ReadVarint(head, end, &tag);
+        if (!head) {
+            return false;
+        }
+        quint32 field = quint32(tag >> 3), wire_type = quint32(tag & 7);
+        Buffer *buffer = field == 1 ? &m_lhs : field == 2 ? &m_rhs : NULL;
+
+        quint64 value;
+        switch (wire_type) {
+        case 0:
+            head = ReadVarint(head, end, &value);
+            if (!head) {
+                return false;
+            }
+            if (buffer) {
+                buffer->reserve(buffer->length + 1);
+                buffer->data[buffer->length++] = qint32(quint32(value));
+            }
+            break;
+        case 1:
+            if (end - head < 8 || buffer) {
+                return false;
+            }
+            head += 8;
+            break;
+        case 2:
+            head = ReadVarint(head, end, &value);
+            if (!head || value > quint64(end - head)) {
+                return false;
+            }
+            if (buffer) {
+                int length = 0;
+                buffer->reserve(buffer->length + int(value) + 16);
+                if (!Decode(head, head + value, buffer->data + buffer->length, &length)) {
+                    return false;
+                }
+                buffer->length += length;
+            }
+            head += value;
+            break;
+        case 5:
+            if (end - head < 4 || buffer) {
+                return false;
+            }
+            head += 4;
+            break;
+        default:
+            return false;
+        }
+    }
+    return m_lhs.length == m_rhs.length;
+}
+
+bool RpcVector::hasZero() const {
+    int zeros = 0;
+    for (int i = 0; i < m_rhs.length; i++) {
+        zeros += m_rhs.data[i] == 0;
+    }
+    return zeros > 0;
+}
+
+std::string RpcVector::compute(Op op) {
+    int length = m_lhs.length;
+    m_out.reserve(length);
+    m_out.length = length;
+
+    switch (op) {
+    case Addition:
+        Add(m_lhs.data, m_rhs.data, m_out.data, length);
+        break;
+    case Subtraction:
+        Sub(m_lhs.data, m_rhs.data, m_out.data, length);
+        break;
+    case Multiplication:
+        Mul(m_lhs.data, m_rhs.data, m_out.data, length);
+        break;
+    case Division:
+        Q_ASSERT(!hasZero());
+        Div(m_lhs.data, m_rhs.data, m_out.data, length);
+        break;
+    default:
+        Q_ASSERT(false);
+    }
+    return Serialize(1, m_out.data, length);
+}
+
+//
+// The kernels expect 32 byte aligned operands; each returns the number of
+// elements it handled, leaving the tail to the scalar loop. An operand may
+// be a scalar instead (`L` or `R`), which is broadcast into a register once
+// rather than loaded per element.
+//
+
+#ifdef RPC_VECTOR_X86
+template <bool Scalar>
+__attribute__((target("avx2")))
+static inline __m256i Load256(const qint32 *data) {
+    return Scalar ? _mm256_set1_epi32(*data) : _mm256_load_si256((const __m256i*)data);
+}
+
+template <bool Scalar>
+__attribute__((target("sse4.1")))
+static inline __m128i Load128(const qint32 *data) {
+    return Scalar ? _mm_set1_epi32(*data) : _mm_load_si128((const __m128i*)data);
+}
+
+template <bool L, bool R>
+__attribute__((target("avx2")))
+static int AddAvx2(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m256i a = Load256<L>(lhs + (L ? 0 : i));
+        __m256i b = Load256<R>(rhs + (R ? 0 : i));
+        _mm256_store_si256((__m256i*)(out + i), _mm256_add_epi32(a, b));
+    }
+    return i;
+}
+
+template <bool L, bool R>
+__attribute__((target("avx2")))
+static int SubAvx2(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m256i a = Load256<L>(lhs + (L ? 0 : i));
+        __m256i b = Load256<R>(rhs + (R ? 0 : i));
+        _mm256_store_si256((__m256i*)(out + i), _mm256_sub_epi32(a, b));
+    }
+    return i;
+}
+
+template <bool L, bool R>
+__attribute__((target("avx2")))
+static int MulAvx2(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m256i a = Load256<L>(lhs + (L ? 0 : i));
+        __m256i b = Load256<R>(rhs + (R ? 0 : i));
+        _mm256_store_si256((__m256i*)(out + i), _mm256_mullo_epi32(a, b));
+    }
+    return i;
+}
+
+//
+// There is no integer division in AVX2/SSE, but an int32 quotient computed
+// in double precision and truncated is exact: The rounding error stays well
+// below the distance 1/|rhs| of a non-integral quotient to an integer.
+//
+
+template <bool L, bool R>
+__attribute__((target("avx2")))
+static int DivAvx2(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256d a = _mm256_cvtepi32_pd(Load128<L>(lhs + (L ? 0 : i)));
+        __m256d b = _mm256_cvtepi32_pd(Load128<R>(rhs + (R ? 0 : i)));
+        _mm_store_si128((__m128i*)(out + i), _mm256_cvttpd_epi32(_mm256_div_pd(a, b)));
+    }
+    return i;
+}
+
+template <bool L, bool R>
+__attribute__((target("sse4.1")))
+static int AddSse4(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m128i a = Load128<L>(lhs + (L ? 0 : i));
+        __m128i b = Load128<R>(rhs + (R ? 0 : i));
+        _mm_store_si128((__m128i*)(out + i), _mm_add_epi32(a, b));
+    }
+    return i;
+}
+
+template <bool L, bool R>
+__attribute__((target("sse4.1")))
+static int SubSse4(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m128i a = Load128<L>(lhs + (L ? 0 : i));
+        __m128i b = Load128<R>(rhs + (R ? 0 : i));
+        _mm_store_si128((__m128i*)(out + i), _mm_sub_epi32(a, b));
+    }
+    return i;
+}
+
+template <bool L, bool R>
+__attribute__((target("sse4.1")))
+static int MulSse4(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m128i a = Load128<L>(lhs + (L ? 0 : i));
+        __m128i b = Load128<R>(rhs + (R ? 0 : i));
+        _mm_store_si128((__m128i*)(out + i), _mm_mullo_epi32(a, b));
+    }
+    return i;
+}
+
+template <bool L, bool R>
+__attribute__((target("sse2")))
+static int DivSse2(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m128i a = L ? _mm_set1_epi32(*lhs) : _mm_load_si128((const __m128i*)(lhs + i));
+        __m128i b = R ? _mm_set1_epi32(*rhs) : _mm_load_si128((const __m128i*)(rhs + i));
+        __m128i lo = _mm_cvttpd_epi32(_mm_div_pd(
+                    _mm_cvtepi32_pd(a), _mm_cvtepi32_pd(b)));
+        __m128i hi = _mm_cvttpd_epi32(_mm_div_pd(
+                    _mm_cvtepi32_pd(_mm_srli_si128(a, 8)),
+                    _mm_cvtepi32_pd(_mm_srli_si128(b, 8))));
+        _mm_store_si128((__m128i*)(out + i), _mm_unpacklo_epi64(lo, hi));
+    }
+    return i;
+}
+
+static const bool g_avx2 = __builtin_cpu_supports("avx2");
+static const bool g_sse4 = __builtin_cpu_supports("sse4.1");
+#endif
+
+namespace {
+    template <bool L, bool R>
+    void AddKernel(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+        int i = 0;
+#ifdef RPC_VECTOR_X86
+        if (g_avx2) {
+            i = AddAvx2<L, R>(lhs, rhs, out, length);
+        } else if (g_sse4) {
+            i = AddSse4<L, R>(lhs, rhs, out, length);
+        }
+#endif
+        for (; i < length; i++) {
+            out[i] = qint32(quint32(lhs[L ? 0 : i]) + quint32(rhs[R ? 0 : i]));
+        }
+    }
+
+    template <bool L, bool R>
+    void SubKernel(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+        int i = 0;
+#ifdef RPC_VECTOR_X86
+        if (g_avx2) {
+            i = SubAvx2<L, R>(lhs, rhs, out, length);
+        } else if (g_sse4) {
+            i = SubSse4<L, R>(lhs, rhs, out, length);
+        }
+#endif
+        for (; i < length; i++) {
+            out[i] = qint32(quint32(lhs[L ? 0 : i]) - quint32(rhs[R ? 0 : i]));
+        }
+    }
+
+    template <bool L, bool R>
+    void MulKernel(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+        int i = 0;
+#ifdef RPC_VECTOR_X86
+        if (g_avx2) {
+            i = MulAvx2<L, R>(lhs, rhs, out, length);
+        } else if (g_sse4) {
+            i = MulSse4<L, R>(lhs, rhs, out, length);
+        }
+#endif
+        for (; i < length; i++) {
+            out[i] = qint32(quint32(lhs[L ? 0 : i]) * quint32(rhs[R ? 0 : i]));
+        }
+    }
+
+    template <bool L, bool R>
+    void DivKernel(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+        int i = 0;
+#ifdef RPC_VECTOR_X86
+        if (g_avx2) {
+            i = DivAvx2<L, R>(lhs, rhs, out, length);
+        } else {
+            i = DivSse2<L, R>(lhs, rhs, out, length);
+        }
+#endif
+        for (; i < length; i++) {
+            qint32 a = lhs[L ? 0 : i], b = rhs[R ? 0 : i];
+            Q_ASSERT(b != 0);
+            out[i] = b == -1 ? qint32(0u - quint32(a)) : a / b;
+        }
+    }
+}
+
+void RpcVector::Add(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    AddKernel<false, false>(lhs, rhs, out, length);
+}
+
+void RpcVector::Add(const qint32 *lhs, qint32 rhs, qint32 *out, int length) {
+    AddKernel<false, true>(lhs, &rhs, out, length);
+}
+
+void RpcVector::Sub(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    SubKernel<false, false>(lhs, rhs, out, length);
+}
+
+void RpcVector::Sub(const qint32 *lhs, qint32 rhs, qint32 *out, int length) {
+    SubKernel<false, true>(lhs, &rhs, out, length);
+}
+
+void RpcVector::Sub(qint32 lhs, const qint32 *rhs, qint32 *out, int length) {
+    SubKernel<true, false>(&lhs, rhs, out, length);
+}
+
+void RpcVector::Mul(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    MulKernel<false, false>(lhs, rhs, out, length);
+}
+
+void RpcVector::Mul(const qint32 *lhs, qint32 rhs, qint32 *out, int length) {
+    MulKernel<false, true>(lhs, &rhs, out, length);
+}
+
+void RpcVector::Div(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length) {
+    DivKernel<false, false>(lhs, rhs, out, length);
+}
+
+void RpcVector::Div(const qint32 *lhs, qint32 rhs, qint32 *out, int length) {
+    Q_ASSERT(rhs != 0);
+    DivKernel<false, true>(lhs, &rhs, out, length);
+}
+
+void RpcVector::Div(qint32 lhs, const qint32 *rhs, qint32 *out, int length) {
+    DivKernel<true, false>(&lhs, rhs, out, length);
+}
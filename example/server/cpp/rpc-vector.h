@@ -0,0 +1,76 @@
+#ifndef RPC_VECTOR_H
+#define RPC_VECTOR_H
+
+#include <QtCore/QtGlobal>
+
+#include <string>
+
+//
+// Element-wise int32 arithmetic for the `Calculator.Service.*Batch` methods:
+// The packed (or repeated) `lhs` and `rhs` operands are decoded straight
+// from the wire into 32 byte aligned buffers, computed on with AVX2 or SSE
+// kernels (chosen at runtime), and the values are encoded straight into a
+// packed result. Like the kernels, results wrap around on overflow.
+//
+
+class RpcVector
+{
+public:
+    enum Op {
+        None, Addition, Subtraction, Multiplication, Division
+    };
+    static Op op(const std::string &name);
+
+    RpcVector();
+    ~RpcVector();
+
+    bool parse(const std::string &data);
+    std::string compute(Op op);
+
+    int length() const { return m_lhs.length; }
+    const qint32 *lhs() const { return m_lhs.data; }
+    const qint32 *rhs() const { return m_rhs.data; }
+    bool hasZero() const;
+
+public:
+    static void Add(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length);
+    static void Sub(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length);
+    static void Mul(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length);
+    static void Div(const qint32 *lhs, const qint32 *rhs, qint32 *out, int length);
+
+    // with a scalar operand (e.g. a constant of an expression):
+    static void Add(const qint32 *lhs, qint32 rhs, qint32 *out, int length);
+    static void Sub(const qint32 *lhs, qint32 rhs, qint32 *out, int length);
+    static void Sub(qint32 lhs, const qint32 *rhs, qint32 *out, int length);
+    static void Mul(const qint32 *lhs, qint32 rhs, qint32 *out, int length);
+    static void Div(const qint32 *lhs, qint32 rhs, qint32 *out, int length);
+    static void Div(qint32 lhs, const qint32 *rhs, qint32 *out, int length);
+
+    //
+    // Varints of packed int32 fields, decoded and encoded with SSE4.1 in the
+    // style of masked VByte (if supported, else by the scalar variants):
+    //
+
+    static const quint8 *Decode(const quint8 *data, const quint8 *end, qint32 *out, int *length);
+    static const quint8 *DecodeScalar(const quint8 *data, const quint8 *end, qint32 *out, int *length);
+    static quint8 *Encode(const qint32 *values, int length, quint8 *out);
+    static quint8 *EncodeScalar(const qint32 *values, int length, quint8 *out);
+    static size_t EncodedSize(const qint32 *values, int length);
+    static std::string Serialize(quint32 field, const qint32 *values, int length);
+
+private:
+    struct Buffer {
+        Buffer() : data(NULL), length(0), capacity(0) {}
+        void reserve(int size);
+        qint32 *data;
+        int length;
+        int capacity;
+    };
+    Buffer m_lhs;
+    Buffer m_rhs;
+    Buffer m_out;
+
+    Q_DISABLE_COPY(RpcVector)
+};
+
+#endif // RPC_VECTOR_H
@@ -0,0 +1,495 @@
+#include "rpc-websocket.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtNetwork/QTcpSocket>
+
+#include <cstring>
+#include <zlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RPC_WEBSOCKET_X86
+#endif
+
+#define RPC_WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define RPC_WEBSOCKET_MAX_HEADER 8192
+#define RPC_WEBSOCKET_MAX_MESSAGE (64 << 20)
+
+RpcWebSocket::RpcWebSocket(QTcpSocket *socket, int deflate_min, QObject *parent)
+    : QObject(parent), m_socket(socket), m_open(false), m_closing(false),
+      m_message_opcode(0), m_message_rsv1(false),
+      m_deflate_min(deflate_min), m_deflate(false), m_deflate_reset(false),
+      m_deflate_bits(MAX_WBITS), m_deflate_ctx(NULL), m_inflate_ctx(NULL)
+{
+    Q_ASSERT(m_socket);
+    m_socket->setParent(this);
+
+    QObject::connect(
+                m_socket, &QTcpSocket::readyRead, this, &RpcWebSocket::onReadyRead);
+    QObject::connect(
+                m_socket, &QTcpSocket::disconnected, this, &RpcWebSocket::disconnected);
+}
+
+RpcWebSocket::~RpcWebSocket() {
+    if (m_deflate_ctx) {
+        deflateEnd(m_deflate_ctx);
+        delete m_deflate_ctx;
+    }
+    if (m_inflate_ctx) {
+        inflateEnd(m_inflate_ctx);
+        delete m_inflate_ctx;
+    }
+}
+
+void RpcWebSocket::onReadyRead() {
+    if (!m_open) {
+        if (!readHandshake()) {
+            return;
+        }
+    }
+    while (m_open && !m_closing && readFrame()) { // nothing after a close
+        continue;
+    }
+}
+
+bool RpcWebSocket::readHandshake() {
+    bool complete = false;
+    while (!complete && m_socket->canReadLine()) {
+        QByteArray line = m_socket->readLine().trimmed();
+        if (!line.isEmpty()) {
+            m_handshake.append(line).append('\n');
+        } else {
+            complete = !m_handshake.isEmpty();
+        }
+    }
+    if (!complete) {
+        if (m_handshake.length() + m_socket->bytesAvailable() > RPC_WEBSOCKET_MAX_HEADER) {
+            m_socket->abort();
+        }
+        return false;
+    }
+
+    QList<QByteArray> lines = m_handshake.trimmed().split('\n');
+    m_handshake = QByteArray();
+    Q_ASSERT(lines.length() > 0);
+
+    QList<QByteArray> request = lines.takeFirst().split(' ');
+    QHash<QByteArray, QByteArray> headers;
+    foreach(QByteArray line, lines) {
+        int colon = line.indexOf(':');
+        if (colon > 0) {
+            QByteArray name = line.left(colon).trimmed().toLower();
+            QByteArray value = line.mid(colon + 1).trimmed();
+            if (headers.contains(name)) {
+                headers[name].append(", ").append(value);
+            } else {
+                headers[name] = value;
+            }
+        }
+    }
+
+    QByteArray key = headers.value("sec-websocket-key");
+    if (request.length() < 3 || request[0] != "GET" || key.isEmpty() ||
+        headers.value("upgrade").toLower() != "websocket") {
+        m_socket->write("HTTP/1.1 400 Bad Request\r\n\r\n");
+        m_socket->disconnectFromHost();
+        return false;
+    }
+
+    QByteArray accept = QCryptographicHash::hash(
+                key + RPC_WEBSOCKET_GUID, QCryptographicHash::Sha1).toBase64();
+
+    QByteArray response = "HTTP/1.1 101 Switching Protocols";
+    response.append("\r\n")
+            .append("Upgrade: ")
+            .append("websocket");
+    response.append("\r\n")
+            .append("Connection: ")
+            .append("Upgrade");
+    response.append("\r\n")
+            .append("Sec-WebSocket-Accept: ")
+            .append(accept);
+
+    QByteArray extension;
+    if (negotiate(headers.value("sec-websocket-extensions"), &extension)) {
+        response.append("\r\n")
+                .append("Sec-WebSocket-Extensions: ")
+                .append(extension);
+    }
+    response.append("\r\n")
+            .append("\r\n");
+
+    qint64 written = m_socket->write(response);
+    Q_ASSERT(written == response.length());
+
+    m_url = QUrl(QString::fromLatin1("ws://%1%2").arg(
+                     QString::fromLatin1(headers.value("host")),
+                     QString::fromLatin1(request[1])));
+    m_open = true;
+
+    emit connected();
+    return true;
+}
+
+bool RpcWebSocket::readFrame() {
+    qint64 available = m_socket->bytesAvailable();
+    if (available < 2) {
+        return false;
+    }
+
+    quint8 header[14];
+    qint64 peeked = m_socket->peek((char*)header, qMin<qint64>(available, sizeof(header)));
+    Q_ASSERT(peeked >= 2);
+
+    bool fin = header[0] & 0x80;
+    bool rsv1 = header[0] & 0x40;
+    quint8 opcode = header[0] & 0x0f;
+    bool masked = header[1] & 0x80;
+    quint64 length = header[1] & 0x7f;
+
+    int offset = 2;
+    if (length == 126) {
+        offset = 4;
+    } else if (length == 127) {
+        offset = 10;
+    }
+    if (peeked < offset + 4) {
+        return false;
+    }
+    if (length == 126) {
+        length = (quint64(header[2]) << 8) | header[3];
+    } else if (length == 127) {
+        length = 0;
+        for (int i = 2; i < 10; i++) {
+            length = (length << 8) | header[i];
+        }
+    }
+
+    if (!masked || (rsv1 && !m_deflate) || (header[0] & 0x30)) {
+        close(1002);
+        return false;
+    }
+    if ((opcode & 0x8) && (!fin || length > 125)) {
+        close(1002); // fragmented or oversized control frame (RFC 6455 5.5)
+        return false;
+    }
+    if (length > RPC_WEBSOCKET_MAX_MESSAGE ||
+        (opcode == 0x0 && m_message.length() + length > RPC_WEBSOCKET_MAX_MESSAGE)) {
+        close(1009);
+        return false;
+    }
+    if (opcode == 0x0 && m_message_opcode == 0) {
+        close(1002);
+        return false;
+    }
+    if (available < offset + 4 + qint64(length)) {
+        return false;
+    }
+
+    qint64 skipped = m_socket->read((char*)header, offset + 4);
+    Q_ASSERT(skipped == offset + 4);
+    const quint8 *mask = header + offset;
+
+    //
+    // Read the payload straight into the buffer which is handed over to
+    // the dispatcher (or appended to the pending fragmented message) and
+    // unmask it there, so no intermediate copies are made:
+    //
+
+    QByteArray payload;
+    char *target;
+    if (opcode == 0x0) {
+        int size = m_message.length();
+        m_message.resize(size + length);
+        target = m_message.data() + size;
+    } else {
+        payload = QByteArray(length, Qt::Uninitialized);
+        target = payload.data();
+    }
+
+    qint64 read = m_socket->read(target, length);
+    Q_ASSERT(read == qint64(length));
+    RpcWebSocket::Unmask((quint8*)target, length, mask);
+
+    onFrame(opcode, fin, rsv1, payload);
+    return true;
+}
+
+void RpcWebSocket::onFrame(quint8 opcode, bool fin, bool rsv1, QByteArray payload) {
+    switch (opcode) {
+    case 0x0: // continuation (already appended)
+        break;
+    case 0x1: // text
+    case 0x2: // binary
+        if (m_message_opcode != 0) {
+            close(1002);
+            return;
+        }
+        m_message = payload;
+        m_message_opcode = opcode;
+        m_message_rsv1 = rsv1;
+        break;
+    case 0x8: // close
+        close(payload.length() >= 2
+              ? quint16((quint8(payload[0]) << 8) | quint8(payload[1])) : 1000);
+        return;
+    case 0x9: // ping
+        sendFrame(0xA, payload);
+        return;
+    case 0xA: // pong
+        return;
+    default:
+        close(1002);
+        return;
+    }
+
+    if (!fin) {
+        return;
+    }
+
+    QByteArray message;
+    message.swap(m_message);
+    quint8 message_opcode = m_message_opcode;
+    m_message_opcode = 0;
+
+    if (m_message_rsv1) {
+        QByteArray inflated;
+        if (!inflate(message, &inflated)) {
+            close(1007);
+            return;
+        }
+        message.swap(inflated);
+    }
+    if (message_opcode == 0x2) {
+        emit binaryMessageReceived(message);
+    }
+}
+
+qint64 RpcWebSocket::sendBinaryMessage(QByteArray bytes) {
+    if (!m_open || m_closing) {
+        return -1;
+    }
+    if (m_deflate && bytes.length() >= m_deflate_min) {
+        sendFrame(0x2, deflate(bytes), true);
+    } else {
+        sendFrame(0x2, bytes);
+    }
+    return bytes.length();
+}
+
+bool RpcWebSocket::flush() {
+    return m_socket->flush();
+}
+
+void RpcWebSocket::close(quint16 code) {
+    if (m_open && !m_closing) {
+        QByteArray payload(2, 0);
+        payload[0] = char(code >> 8);
+        payload[1] = char(code & 0xff);
+        sendFrame(0x8, payload);
+        m_closing = true;
+    }
+    m_socket->disconnectFromHost();
+}
+
+void RpcWebSocket::sendFrame(quint8 opcode, QByteArray payload, bool rsv1) {
+    quint8 header[10];
+    header[0] = 0x80 | (rsv1 ? 0x40 : 0x00) | opcode;
+
+    int size = 2;
+    quint64 length = payload.length();
+    if (length < 126) {
+        header[1] = quint8(length);
+    } else if (length <= 0xffff) {
+        header[1] = 126;
+        header[2] = quint8(length >> 8);
+        header[3] = quint8(length);
+        size = 4;
+    } else {
+        header[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            header[2 + i] = quint8(length >> (56 - 8 * i));
+        }
+        size = 10;
+    }
+
+    m_socket->write((const char*)header, size);
+    m_socket->write(payload);
+}
+
+bool RpcWebSocket::negotiate(QByteArray offers, QByteArray *response) {
+    if (m_deflate_min < 0 || offers.isEmpty()) {
+        return false;
+    }
+
+    foreach(QByteArray offer, offers.split(',')) {
+        QList<QByteArray> params = offer.split(';');
+        if (params.takeFirst().trimmed() != "permessage-deflate") {
+            continue;
+        }
+
+        bool valid = true, reset = false;
+        int bits = MAX_WBITS;
+        QByteArray accepted = "permessage-deflate";
+        foreach(QByteArray param, params) {
+            QList<QByteArray> pair = param.trimmed().split('=');
+            QByteArray name = pair[0].trimmed();
+            QByteArray value = pair.length() > 1
+                    ? pair[1].trimmed().replace('"', "") : QByteArray();
+
+            if (name == "server_no_context_takeover") {
+                reset = true;
+                accepted.append("; server_no_context_takeover");
+            } else if (name == "client_no_context_takeover") {
+                accepted.append("; client_no_context_takeover");
+            } else if (name == "server_max_window_bits") {
+                bits = value.toInt();
+                // zlib's raw deflate does not support a window of 2^8:
+                valid = valid && bits >= 9 && bits <= MAX_WBITS;
+                accepted.append("; server_max_window_bits=").append(value);
+            } else if (name == "client_max_window_bits") {
+                continue; // inflating with the maximum window accepts any
+            } else {
+                valid = false;
+            }
+        }
+        if (valid) {
+            m_deflate = true;
+            m_deflate_reset = reset;
+            m_deflate_bits = bits;
+            *response = accepted;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+QByteArray RpcWebSocket::deflate(QByteArray bytes) {
+    if (m_deflate_ctx == NULL) {
+        m_deflate_ctx = new z_stream;
+        memset(m_deflate_ctx, 0, sizeof(z_stream));
+        int init = deflateInit2(
+                    m_deflate_ctx, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                    -m_deflate_bits, 8, Z_DEFAULT_STRATEGY);
+        Q_ASSERT(init == Z_OK);
+    }
+
+    QByteArray result(deflateBound(m_deflate_ctx, bytes.length()) + 16, 0);
+    m_deflate_ctx->next_in = (Bytef*)bytes.data();
+    m_deflate_ctx->avail_in = bytes.length();
+
+    int size = 0;
+    do {
+        if (size == result.length()) {
+            result.resize(2 * size);
+        }
+        m_deflate_ctx->next_out = (Bytef*)result.data() + size;
+        m_deflate_ctx->avail_out = result.length() - size;
+        int status = ::deflate(m_deflate_ctx, Z_SYNC_FLUSH);
+        Q_ASSERT(status == Z_OK || status == Z_BUF_ERROR);
+        size = result.length() - m_deflate_ctx->avail_out;
+    } while (m_deflate_ctx->avail_out == 0);
+
+    // strip the 0x00 0x00 0xff 0xff tail of the sync flush (RFC 7692 7.2.1):
+    Q_ASSERT(size >= 4);
+    result.resize(size - 4);
+
+    if (m_deflate_reset) {
+        deflateReset(m_deflate_ctx);
+    }
+    return result;
+}
+
+bool RpcWebSocket::inflate(QByteArray bytes, QByteArray *result) {
+    if (m_inflate_ctx == NULL) {
+        m_inflate_ctx = new z_stream;
+        memset(m_inflate_ctx, 0, sizeof(z_stream));
+        int init = inflateInit2(m_inflate_ctx, -MAX_WBITS);
+        Q_ASSERT(init == Z_OK);
+    }
+
+    bytes.append("\x00\x00\xff\xff", 4);
+    m_inflate_ctx->next_in = (Bytef*)bytes.data();
+    m_inflate_ctx->avail_in = bytes.length();
+
+    result->resize(qMax(4 * bytes.length(), 256));
+    int size = 0;
+    while (true) {
+        m_inflate_ctx->next_out = (Bytef*)result->data() + size;
+        m_inflate_ctx->avail_out = result->length() - size;
+        int status = ::inflate(m_inflate_ctx, Z_SYNC_FLUSH);
+        if (status != Z_OK && status != Z_BUF_ERROR && status != Z_STREAM_END) {
+            return false;
+        }
+        size = result->length() - m_inflate_ctx->avail_out;
+        if (status == Z_STREAM_END) {
+            inflateReset(m_inflate_ctx);
+            break;
+        }
+        if (m_inflate_ctx->avail_out > 0) {
+            if (m_inflate_ctx->avail_in > 0) {
+                return false;
+            }
+            break;
+        }
+        if (size > RPC_WEBSOCKET_MAX_MESSAGE) {
+            return false;
+        }
+        result->resize(2 * result->length());
+    }
+
+    result->resize(size);
+    return true;
+}
+
+#ifdef RPC_WEBSOCKET_X86
+__attribute__((target("avx2")))
+static qint64 UnmaskAvx2(quint8 *data, qint64 length, quint32 mask) {
+    const __m256i key = _mm256_set1_epi32(mask);
+    qint64 i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+        _mm256_storeu_si256((__m256i*)(data + i), _mm256_xor_si256(block, key));
+    }
+    return i;
+}
+
+__attribute__((target("sse2")))
+static qint64 UnmaskSse2(quint8 *data, qint64 length, quint32 mask) {
+    const __m128i key = _mm_set1_epi32(mask);
+    qint64 i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+        _mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(block, key));
+    }
+    return i;
+}
+#endif
+
+void RpcWebSocket::Unmask(quint8 *data, qint64 length, const quint8 *mask) {
+    quint32 key;
+    memcpy(&key, mask, sizeof(key));
+
+    qint64 i = 0;
+#ifdef RPC_WEBSOCKET_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        i += UnmaskAvx2(data, length, key);
+    }
+    i += UnmaskSse2(data + i, length - i, key);
+#else
+    for (; i + 4 <= length; i += 4) {
+        quint32 word;
+        memcpy(&word, data + i, sizeof(word));
+        word ^= key;
+        memcpy(data + i, &word, sizeof(word));
+    }
+#endif
+    for (; i < length; i++) {
+        data[i] ^= mask[i & 3];
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef RPC_WEBSOCKET_H
+#define RPC_WEBSOCKET_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+#include <QtCore/QUrl>
+
+QT_FORWARD_DECLARE_CLASS(QTcpSocket)
+
+struct z_stream_s;
+
+//
+// Minimal server side WebSocket (RFC 6455) on top of a QTcpSocket, which
+// unlike QWebSocket negotiates the permessage-deflate extension (RFC 7692):
+// Messages of at least `deflate_min` bytes are compressed; a negative value
+// declines the extension. The (de-)compression contexts are created on first
+// use and then kept for the lifetime of the connection.
+//
+// Frames are read directly from the socket into the message buffer and are
+// unmasked in place (with SSE2/AVX2 where available); apart from the socket
+// there are no per connection buffers unless a message is fragmented.
+//
+
+class RpcWebSocket : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RpcWebSocket(QTcpSocket *socket, int deflate_min = -1, QObject *parent = 0);
+    ~RpcWebSocket();
+
+Q_SIGNALS:
+    void connected();
+    void binaryMessageReceived(QByteArray bytes);
+    void disconnected();
+
+public:
+    static void Unmask(quint8 *data, qint64 length, const quint8 *mask);
+public:
+    QUrl requestUrl() const { return m_url; }
+    qint64 sendBinaryMessage(QByteArray bytes);
+    bool flush();
+    void close(quint16 code = 1000);
+
+private Q_SLOTS:
+    void onReadyRead();
+
+private:
+    bool readHandshake();
+    bool readFrame();
+    void onFrame(quint8 opcode, bool fin, bool rsv1, QByteArray payload);
+    void sendFrame(quint8 opcode, QByteArray payload, bool rsv1 = false);
+
+private:
+    QTcpSocket *m_socket;
+    QByteArray m_handshake;
+    QUrl m_url;
+    bool m_open;
+    bool m_closing;
+
+private:
+    QByteArray m_message;
+    quint8 m_message_opcode;
+    bool m_message_rsv1;
+
+private:
+    bool negotiate(QByteArray offers, QByteArray *response);
+    QByteArray deflate(QByteArray bytes);
+    bool inflate(QByteArray bytes, QByteArray *result);
+
+private:
+    int m_deflate_min;
+    bool m_deflate;
+    bool m_deflate_reset;
+    int m_deflate_bits;
+    z_stream_s *m_deflate_ctx;
+    z_stream_s *m_inflate_ctx;
+};
+
+#endif // RPC_WEBSOCKET_H
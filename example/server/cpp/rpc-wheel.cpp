@@ -0,0 +1,53 @@
+#include "rpc-wheel.h"
+
+#include <QtCore/QTimer>
+
+RpcWheel::RpcWheel(int tick_ms, int slots, QObject *parent)
+    : QObject(parent), m_slots(slots), m_tick(0), m_tick_ms(tick_ms), m_size(0)
+{
+    Q_ASSERT(tick_ms > 0);
+    Q_ASSERT(slots > 1);
+    m_clock.start();
+
+    m_timer = new QTimer(this);
+    Q_ASSERT(m_timer);
+    m_timer->setInterval(tick_ms);
+    m_timer->setTimerType(Qt::CoarseTimer);
+
+    QObject::connect(
+                m_timer, &QTimer::timeout, this, &RpcWheel::onTick);
+}
+
+void RpcWheel::schedule(quint64 id, qint64 deadline) {
+    if (m_size == 0) {
+        m_tick = now() / m_tick_ms;
+    }
+    qint64 tick = (deadline + m_tick_ms - 1) / m_tick_ms;
+    tick = qBound(m_tick + 1, tick, m_tick + m_slots.size() - 1);
+
+    m_slots[tick % m_slots.size()] << id;
+    m_size += 1;
+
+    if (!m_timer->isActive()) {
+        m_timer->start();
+    }
+}
+
+void RpcWheel::onTick() {
+    qint64 tick = now() / m_tick_ms;
+    while (m_tick < tick) {
+        m_tick += 1;
+
+        QVector<quint64> ids;
+        ids.swap(m_slots[m_tick % m_slots.size()]);
+        m_size -= ids.size();
+        Q_ASSERT(m_size >= 0);
+
+        foreach(quint64 id, ids) {
+            emit expired(id);
+        }
+    }
+    if (m_size == 0) {
+        m_timer->stop();
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef RPC_WHEEL_H
+#define RPC_WHEEL_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QObject>
+#include <QtCore/QVector>
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+//
+// Hashed timing wheel for connection ids driven by a single timer: Each id
+// sits in exactly one slot; once its slot's tick has passed `expired` is
+// emitted, and the receiver decides whether the connection is really idle
+// (and closes it) or re-schedules it. Hence recording activity does not need
+// to touch the wheel at all, it only updates a timestamp of the connection.
+//
+
+class RpcWheel : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RpcWheel(int tick_ms = 1000, int slots = 64, QObject *parent = 0);
+
+Q_SIGNALS:
+    void expired(quint64 id);
+
+public:
+    qint64 now() const { return m_clock.elapsed(); }
+    void schedule(quint64 id, qint64 deadline);
+
+private Q_SLOTS:
+    void onTick();
+
+private:
+    QElapsedTimer m_clock;
+    QTimer *m_timer;
+    QVector<QVector<quint64> > m_slots;
+    qint64 m_tick;
+    int m_tick_ms;
+    int m_size;
+};
+
+#endif // RPC_WHEEL_H
@@ -69,6 +69,141 @@ function subscriber(rpc_req) {
     }
 }
 
+function elementwise(rpc_req, req, fn) {
+    if (req.lhs.length !== req.rhs.length) {
+        throw new Error(rpc_req.name + ': operands mismatch');
+    }
+    return req.lhs.map(function (lhs, i) {
+        return fn(lhs, req.rhs[i]);
+    });
+}
+
+function evaluate(rpc_req, expr, row) {
+    switch (expr.node) {
+        case 'constant':
+            return expr.constant;
+        case 'variable':
+            return row[expr.variable];
+        case 'binary':
+            let lhs = evaluate(rpc_req, expr.binary.lhs, row),
+                rhs = evaluate(rpc_req, expr.binary.rhs, row);
+            switch (expr.binary.op) {
+                case Api.Calculator.Expr.Op.ADD:
+                    return lhs + rhs | 0;
+                case Api.Calculator.Expr.Op.SUB:
+                    return lhs - rhs | 0;
+                case Api.Calculator.Expr.Op.MUL:
+                    return Math.imul(lhs, rhs);
+                case Api.Calculator.Expr.Op.DIV:
+                    if (rhs === 0) {
+                        throw new Error(rpc_req.name + ': division by zero');
+                    }
+                    return lhs / rhs | 0;
+            }
+    }
+    throw new Error(rpc_req.name + ': invalid expression');
+}
+
+function variables(expr) {
+    switch (expr.node) {
+        case 'variable':
+            return expr.variable + 1;
+        case 'binary':
+            return Math.max(variables(expr.binary.lhs),
+                            variables(expr.binary.rhs));
+        default:
+            return 0;
+    }
+}
+
+function bind(source, source_field, target_field, target) {
+    let reader = ProtoBuf.Reader.create(source), value = null;
+    while (reader.pos < reader.len) {
+        let tag = reader.uint32(), begin = reader.pos;
+        reader.skipType(tag & 7);
+        if (tag >>> 3 === source_field) {
+            value = {
+                wire_type: tag & 7, bytes: source.slice(begin, reader.pos)
+            };
+        }
+    }
+    if (value === null) {
+        return strip(target, target_field); // default value
+    }
+    return Buffer.concat([target, ProtoBuf.Writer.create().uint32(
+        target_field << 3 | value.wire_type
+    ).finish(), value.bytes]);
+}
+
+function strip(data, field) {
+    let reader = ProtoBuf.Reader.create(data), kept = [];
+    while (reader.pos < reader.len) {
+        let begin = reader.pos, tag = reader.uint32();
+        reader.skipType(tag & 7);
+        if (tag >>> 3 !== field) {
+            kept.push(data.slice(begin, reader.pos));
+        }
+    }
+    return Buffer.concat(kept);
+}
+
+function pipeline(rpc_reqs) {
+    let ids = rpc_reqs.map(function (rpc_sub) {
+        return rpc_sub.id;
+    });
+
+    let results = {}, pending = rpc_reqs;
+    while (pending.length > 0) {
+        let wave = [], waiting = [], failed = 0;
+        pending.forEach(function (rpc_sub) {
+            let unresolved = false, ready = true;
+            rpc_sub.binds.forEach(function (b) {
+                if (ids.indexOf(b.source) < 0 || b.source === rpc_sub.id ||
+                    results[b.source] === null) {
+                    unresolved = true;
+                } else if (!(b.source in results)) {
+                    ready = false;
+                }
+            });
+            if (unresolved) {
+                console.error('[on:error]', rpc_sub.name + ': unresolved bind');
+                results[rpc_sub.id] = null;
+                failed += 1;
+            } else if (ready) {
+                wave.push(rpc_sub);
+            } else {
+                waiting.push(rpc_sub);
+            }
+        });
+        if (wave.length === 0 && failed === 0) {
+            console.error('[on:error]', '.Rpc.Pipeline: cyclic bind');
+            break;
+        }
+        wave.forEach(function (rpc_sub) {
+            let data = rpc_sub.binds.reduce(function (data, b) {
+                return bind(results[b.source], b.sourceField, b.targetField, data);
+            }, rpc_sub.data);
+            try {
+                results[rpc_sub.id] = processor({
+                    name: rpc_sub.name, id: rpc_sub.id, data: data
+                }, {
+                    nested: true
+                });
+            } catch (ex) {
+                console.error('[on:error]', ex.message);
+                results[rpc_sub.id] = null;
+            }
+        });
+        pending = waiting;
+    }
+
+    return rpc_reqs.filter(function (rpc_sub) {
+        return results[rpc_sub.id];
+    }).map(function (rpc_sub) {
+        return {id: rpc_sub.id, data: results[rpc_sub.id]};
+    });
+}
+
 function processor(rpc_req, opts) {
 
     switch (rpc_req.name) {
@@ -107,6 +242,64 @@ function processor(rpc_req, opts) {
             });
             break;
 
+        case '.Calculator.Service.addBatch':
+            req = Api.Calculator.AddBatchRequest.decode(rpc_req.data);
+            res = Api.Calculator.AddBatchResult.encode({
+                values: elementwise(rpc_req, req, function (lhs, rhs) {
+                    return lhs + rhs | 0;
+                })
+            });
+            break;
+
+        case '.Calculator.Service.subBatch':
+            req = Api.Calculator.SubBatchRequest.decode(rpc_req.data);
+            res = Api.Calculator.SubBatchResult.encode({
+                values: elementwise(rpc_req, req, function (lhs, rhs) {
+                    return lhs - rhs | 0;
+                })
+            });
+            break;
+
+        case '.Calculator.Service.mulBatch':
+            req = Api.Calculator.MulBatchRequest.decode(rpc_req.data);
+            res = Api.Calculator.MulBatchResult.encode({
+                values: elementwise(rpc_req, req, function (lhs, rhs) {
+                    return Math.imul(lhs, rhs);
+                })
+            });
+            break;
+
+        case '.Calculator.Service.divBatch':
+            req = Api.Calculator.DivBatchRequest.decode(rpc_req.data);
+            res = Api.Calculator.DivBatchResult.encode({
+                values: elementwise(rpc_req, req, function (lhs, rhs) {
+                    if (rhs === 0) {
+                        throw new Error(rpc_req.name + ': division by zero');
+                    }
+                    return lhs / rhs | 0;
+                })
+            });
+            break;
+
+        case '.Calculator.Service.eval':
+            req = Api.Calculator.EvalRequest.decode(rpc_req.data);
+            if (!req.expr) {
+                throw new Error(rpc_req.name + ': missing expression');
+            }
+            let arity = req.arity || variables(req.expr), rows = [];
+            if (arity < variables(req.expr) || req.inputs.length % (arity || 1)) {
+                throw new Error(rpc_req.name + ': inputs mismatch');
+            }
+            for (let i = 0; i < (arity ? req.inputs.length : arity + 1); i += arity || 1) {
+                rows.push(req.inputs.slice(i, i + arity));
+            }
+            res = Api.Calculator.EvalResult.encode({
+                values: rows.map(function (row) {
+                    return evaluate(rpc_req, req.expr, row);
+                })
+            });
+            break;
+
         case '.Listener.Service.sub':
             req = Api.Listener.SubRequest.decode(rpc_req.data);
             res = Api.Listener.SubResult.encode({
@@ -114,6 +307,34 @@ function processor(rpc_req, opts) {
             });
             break;
 
+        case '.Rpc.Batch':
+            if (opts && opts.nested) {
+                throw new Error(rpc_req.name + ': nested batch');
+            }
+            return Rpc.Batch.encode({
+                responses: Rpc.Batch.decode(rpc_req.data).requests.reduce(
+                    function (rpc_ress, rpc_sub) {
+                        try {
+                            rpc_ress.push({
+                                id: rpc_sub.id, data: processor(rpc_sub, {
+                                    nested: true
+                                })
+                            });
+                        } catch (ex) {
+                            console.error('[on:error]', ex.message);
+                        }
+                        return rpc_ress;
+                    }, [])
+            }).finish();
+
+        case '.Rpc.Pipeline':
+            if (opts && opts.nested) {
+                throw new Error(rpc_req.name + ': nested pipeline');
+            }
+            return Rpc.Batch.encode({
+                responses: pipeline(Rpc.Batch.decode(rpc_req.data).requests)
+            }).finish();
+
         default:
             throw new Error(rpc_req.name + ': not supported');
     }
@@ -129,6 +350,7 @@ let wss = new WebSocket.Server({
 });
 
 wss.on('connection', function (ws) {
+    let streams = {};
     ws.on('message', function (data, flags) {
 
         if (args.logging) {
@@ -136,8 +358,11 @@ wss.on('connection', function (ws) {
         }
 
         let rpc_req = RpcDecode(data);
-        if (subscriber(rpc_req)) {
-            let iid = setInterval(function () {
+        if (rpc_req.name === '.Rpc.Cancel') {
+            clearInterval(streams[rpc_req.id]);
+            delete streams[rpc_req.id];
+        } else if (subscriber(rpc_req)) {
+            let iid = streams[rpc_req.id] = setInterval(function () {
                 let rpc_res = RpcEncode({
                     id: rpc_req.id, data: processor(rpc_req, {
                         timestamp: new Date().toISOString()
@@ -156,6 +381,11 @@ wss.on('connection', function (ws) {
             ws.send(rpc_res.finish());
         }
     });
+    ws.on('close', function () {
+        Object.keys(streams).forEach(function (id) {
+            clearInterval(streams[id]);
+        });
+    });
 });
 
 ///////////////////////////////////////////////////////////////////////////////
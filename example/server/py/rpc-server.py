@@ -17,7 +17,7 @@ from protocol import calculator_pb2 as Calculator
 ###############################################################################
 ###############################################################################
 
-def process(data):
+def process(data, nested=False):
     rpc_req = Rpc.Request()
     rpc_req.ParseFromString(data)
 
@@ -51,6 +51,22 @@ def process(data):
         res = Calculator.DivResult()
         res.value = req.lhs / req.rhs
 
+    elif rpc_req.name == '.Rpc.Batch':
+        if nested:
+            raise Exception('{0}: nested batch'.format(rpc_req.name))
+        req = Rpc.Batch()
+        req.ParseFromString(rpc_req.data)
+        res = Rpc.Batch()
+        for sub_req in req.requests:
+            try:
+                sub_res = process(sub_req.SerializeToString(), nested=True)
+                res.responses.add().ParseFromString(sub_res)
+            except Exception as ex:
+                print '[on:error]', ex
+
+    elif rpc_req.name == '.Rpc.Cancel':
+        return None # nothing is queued to cancel
+
     else:
         raise Exception('{0}: not supported'.format(rpc_req.name))
 
@@ -69,7 +85,9 @@ class WebSocketHandler(tornado.websocket.WebSocketHandler):
         if arguments.logging:
             print '[on:message]', repr(data)
 
-        self.write_message(process(data), binary=True)
+        rpc_res = process(data)
+        if rpc_res is not None:
+            self.write_message(rpc_res, binary=True)
 
     def check_origin(self, origin):
 
@@ -8,6 +8,11 @@ let WebSocket = require('ws'),
 let assert = require('assert'),
     crypto = require('crypto');
 
+let DEADLINE_EXCEEDED = 1; // Rpc.Response.Status
+let PRIORITIES = { // Rpc.Request.Priority
+    high: 1, normal: 2, low: 3
+};
+
 function mine(fn) {
     return function () {
         return fn.apply(this, [this].concat(Array.prototype.slice.call(
@@ -75,6 +80,13 @@ let Encoding = {
             },
             decode: function (buf, cls) {
                 return cls.decodeDelimited(buf);
+            },
+            decodeAll: function (buf, cls) {
+                let reader = ProtoBuf.Reader.create(buf), objs = [];
+                while (reader.pos < reader.len) {
+                    objs.push(cls.decodeDelimited(reader));
+                }
+                return objs;
             }
         };
     }
@@ -146,6 +158,22 @@ let Service = mine(function (self, service_cls, opts) {
                                 },
                                 "data": {
                                     id: 3, type: "bytes"
+                                },
+                                "binds": {
+                                    rule: "repeated", id: 4, type: "Bind"
+                                },
+                                "timeout": {
+                                    id: 5, type: "uint32"
+                                },
+                                "priority": {
+                                    id: 6, type: "Priority"
+                                }
+                            },
+                            nested: {
+                                "Priority": {
+                                    values: {
+                                        "DEFAULT": 0, "HIGH": 1, "NORMAL": 2, "LOW": 3
+                                    }
                                 }
                             }
                         },
@@ -156,6 +184,39 @@ let Service = mine(function (self, service_cls, opts) {
                                 },
                                 "data": {
                                     id: 3, type: "bytes"
+                                },
+                                "status": {
+                                    id: 4, type: "Status"
+                                }
+                            },
+                            nested: {
+                                "Status": {
+                                    values: {
+                                        "OK": 0, "DEADLINE_EXCEEDED": 1
+                                    }
+                                }
+                            }
+                        },
+                        "Batch": {
+                            fields: {
+                                "requests": {
+                                    rule: "repeated", id: 1, type: "Request"
+                                },
+                                "responses": {
+                                    rule: "repeated", id: 2, type: "Response"
+                                }
+                            }
+                        },
+                        "Bind": {
+                            fields: {
+                                "source": {
+                                    id: 1, type: "fixed32"
+                                },
+                                "sourceField": {
+                                    id: 2, type: "uint32"
+                                },
+                                "targetField": {
+                                    id: 3, type: "uint32"
                                 }
                             }
                         }
@@ -175,12 +236,18 @@ let Service = mine(function (self, service_cls, opts) {
 
     assert(self.on_msg === undefined);
     self.on_msg = function (buf) {
-        let rpc_res = self.encoding.decode(
+        let rpc_ress = self.encoding.decodeAll ? self.encoding.decodeAll(
             buf, self.rpc_message.Response
-        );
-        if (self.do_msg[rpc_res.id]) {
-            self.do_msg[rpc_res.id](rpc_res.data);
-        }
+        ) : [self.encoding.decode(
+            buf, self.rpc_message.Response
+        )];
+        rpc_ress.forEach(function (rpc_res) {
+            if (rpc_res.status === DEADLINE_EXCEEDED) {
+                self.on_err(new Error('deadline exceeded'), rpc_res.id);
+            } else if (self.do_msg[rpc_res.id]) {
+                self.do_msg[rpc_res.id](rpc_res.data);
+            }
+        });
     };
 
     assert(self.on_err === undefined);
@@ -190,6 +257,71 @@ let Service = mine(function (self, service_cls, opts) {
         }
     };
 
+    //
+    // With `opts.timeout` (in milli-seconds) a server drops requests which
+    // waited longer for a worker, and answers them with a status instead;
+    // `opts.priority` ('high', 'normal' or 'low') overrides the priority the
+    // server assigns to a method.
+    //
+
+    assert(self.send === undefined);
+    self.send = function (name, random_id, data) {
+        let rpc_req = self.encoding.encode({
+            name: name, id: random_id, data: data, timeout: opts.timeout,
+            priority: PRIORITIES[opts.priority]
+        }, self.rpc_message.Request);
+
+        self.transport.send(
+            rpc_req.finish(), self.on_msg, function (err) {
+                self.on_err(err, random_id);
+            }
+        );
+    };
+
+    //
+    // With `opts.batch` the (non-streaming) calls made within the same
+    // microtask are gathered and sent as a single `.Rpc.Batch` request; the
+    // server omits the responses of failed calls, which are errored here.
+    //
+
+    assert(self.batch === undefined);
+    self.batch = null;
+    self.flush = function () {
+        let batch = self.batch;
+        self.batch = null;
+        if (batch.length === 1) {
+            return self.send(batch[0].name, batch[0].id, batch[0].data);
+        }
+
+        let batch_id = crypto.randomBytes(4).readUInt32LE();
+        self.do_msg[batch_id] = function (buf) {
+            delete self.do_msg[batch_id];
+            delete self.do_err[batch_id];
+
+            let rpc_ress = self.rpc_message.Batch.decode(buf).responses;
+            rpc_ress.forEach(function (rpc_res) {
+                if (self.do_msg[rpc_res.id]) {
+                    self.do_msg[rpc_res.id](rpc_res.data);
+                }
+            });
+            batch.forEach(function (rpc_req) {
+                self.on_err(new Error(rpc_req.name + ': failed'), rpc_req.id);
+            });
+        };
+        self.do_err[batch_id] = function (err) {
+            delete self.do_msg[batch_id];
+            delete self.do_err[batch_id];
+
+            batch.forEach(function (rpc_req) {
+                self.on_err(err, rpc_req.id);
+            });
+        };
+
+        self.send('.Rpc.Batch', batch_id, self.rpc_message.Batch.encode({
+            requests: batch
+        }).finish());
+    };
+
     let service = service_cls.create(function (ended) {
         return function (method, req, cb) {
             if (ended || !req) {
@@ -200,10 +332,6 @@ let Service = mine(function (self, service_cls, opts) {
             let random_id = crypto.randomBytes(4).readUInt32LE();
             assert(random_id >= 0);
 
-            let rpc_req = self.encoding.encode({
-                name: method.fullName, id: random_id, data: req
-            }, self.rpc_message.Request);
-
             self.do_msg[random_id] = function (buf) {
                 if (method.responseStream !== true) {
                     delete self.do_msg[random_id];
@@ -217,14 +345,112 @@ let Service = mine(function (self, service_cls, opts) {
                 cb(err, null);
             };
 
-            self.transport.send(
-                rpc_req.finish(), self.on_msg, function (err) {
-                    self.on_err(err, random_id);
+            if (opts.batch && method.responseStream !== true) {
+                if (self.batch === null) {
+                    self.batch = [];
+                    Promise.resolve().then(self.flush);
                 }
-            );
+                self.batch.push({
+                    name: method.fullName, id: random_id, data: req
+                });
+            } else {
+                self.send(method.fullName, random_id, req);
+            }
         };
     }());
 
+    //
+    // A pipeline is a batch whose calls may take fields of earlier calls'
+    // results, e.g. `{method: 'mul', req: {rhs: 4}, bind: {lhs: [0, 'value']}}`
+    // takes `lhs` from the `value` of call #0: The server resolves the binds,
+    // so the whole chain costs a single round trip. The callback receives the
+    // results in call order (with `null` for each failed call).
+    //
+
+    service.pipeline = function (calls, callback) {
+        let methods = calls.map(function (call) {
+            let method = service_cls.methods[call.method];
+            assert(method, call.method + ': not supported');
+            assert(method.responseStream !== true, call.method + ': stream');
+            if (method.resolved !== true) {
+                method.resolve();
+            }
+            return method;
+        });
+        let ids = calls.map(function () {
+            return crypto.randomBytes(4).readUInt32LE();
+        });
+        let rpc_reqs = calls.map(function (call, i) {
+            let binds = Object.keys(call.bind || {}).map(function (target) {
+                let source = call.bind[target];
+                return {
+                    source: ids[source[0]],
+                    sourceField: methods[source[0]].resolvedResponseType
+                        .fields[source[1]].id,
+                    targetField: methods[i].resolvedRequestType
+                        .fields[target].id
+                };
+            });
+            return {
+                name: methods[i].fullName, id: ids[i], binds: binds,
+                data: methods[i].resolvedRequestType.encode(call.req || {})
+                    .finish()
+            };
+        });
+
+        let pipeline_id = crypto.randomBytes(4).readUInt32LE();
+        self.do_msg[pipeline_id] = function (buf) {
+            delete self.do_msg[pipeline_id];
+            delete self.do_err[pipeline_id];
+
+            let results = calls.map(function () { return null; });
+            let rpc_ress = self.rpc_message.Batch.decode(buf).responses;
+            rpc_ress.forEach(function (rpc_res) {
+                let i = ids.indexOf(rpc_res.id);
+                if (i >= 0) {
+                    results[i] = methods[i].resolvedResponseType.decode(
+                        rpc_res.data);
+                }
+            });
+            let failed = results.reduce(function (failed, res, i) {
+                return res === null ? failed.concat([i]) : failed;
+            }, []);
+            callback(failed.length > 0 ? new Error(
+                '.Rpc.Pipeline: failed call(s) ' + failed.join(', ')
+            ) : null, results);
+        };
+        self.do_err[pipeline_id] = function (err) {
+            delete self.do_msg[pipeline_id];
+            delete self.do_err[pipeline_id];
+            callback(err, null);
+        };
+
+        self.send('.Rpc.Pipeline', pipeline_id, self.rpc_message.Batch.encode({
+            requests: rpc_reqs
+        }).finish());
+    };
+
+    //
+    // Cancels every outstanding call (including streams), whose callbacks
+    // receive an error: Over a WebSocket the server is sent a `.Rpc.Cancel`
+    // per call, and drops a call not started yet (or flags a running one).
+    //
+
+    service.cancel = function () {
+        Object.keys(self.do_err).forEach(function (key) {
+            let random_id = parseInt(key);
+            if (self.do_err[random_id] === undefined) {
+                return; // errored along with its batch
+            }
+            if (self.transport instanceof Transport.Ws) {
+                self.send('.Rpc.Cancel', random_id);
+            }
+            self.on_err(new Error('cancelled'), random_id);
+            delete self.do_msg[random_id];
+            delete self.do_err[random_id];
+        });
+    };
+
     self.transport.socket.on('open', function () {
         service.emit('open', {url: self.url});
     });
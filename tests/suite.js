@@ -12,6 +12,16 @@ let server_2 = spawn('node', [
     '--delimited'
 ]);
 
+//
+// The QT/C++ server (if built) with a single worker, such that requests
+// queue deterministically behind a slow one:
+//
+
+let rpc_server_cpp = 'example/server/cpp/build/rpc-server';
+let server_3 = require('fs').existsSync(rpc_server_cpp) ? spawn(rpc_server_cpp, [
+    '--xhr-port=38088', '--ws-port=38089', '--threads=1'
+]) : null;
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -50,6 +60,9 @@ Suite.run = function (tests) {
         suite.run(false, function () {
             server_1.kill();
             server_2.kill();
+            if (server_3) {
+                server_3.kill();
+            }
             summarize();
         });
     }, 600);
@@ -63,6 +76,42 @@ assert(ProtoBuf);
 ProtoBuf.Rpc = require('../index.js');
 assert(ProtoBuf.Rpc);
 
+//
+// Transport answering each request in-process via `reply(rpc_req)`, to
+// inspect the envelopes a client sends:
+//
+
+let Loopback = function (reply) {
+    let Rpc = ProtoBuf.loadSync('protocol/rpc.proto').lookup('Rpc');
+    return {
+        open: function () {
+            let socket = this.socket = new ProtoBuf.util.EventEmitter();
+            setTimeout(function () { socket.emit('open'); }, 0);
+        },
+        send: function (buf, msg_cb) {
+            msg_cb(Rpc.Response.encode(reply(Rpc.Request.decode(buf))).finish());
+        }
+    };
+};
+
+//
+// Evaluation request of a balanced tree of `2^depth - 1` additions over
+// `rows` inputs, which keeps a worker busy while being small on the wire:
+//
+
+let SlowEval = function (Api, depth, rows) {
+    let tree = function (depth) {
+        return depth > 0 ? {binary: {
+            op: Api.Calculator.Expr.Op.ADD, lhs: tree(depth - 1), rhs: tree(depth - 1)
+        }} : {variable: 0};
+    };
+    let inputs = [];
+    for (let i = 0; i < rows; i++) {
+        inputs.push(i % 1000);
+    }
+    return {expr: tree(depth), inputs: inputs, arity: 1};
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 
 Suite.run({
@@ -357,6 +406,11 @@ Suite.run({
             test.ok(Calculator.DivRequest);
             test.ok(Calculator.DivResult);
             test.ok(Calculator.Service.methods.div);
+            test.ok(Calculator.Service.methods.addBatch);
+            test.ok(Calculator.Service.methods.subBatch);
+            test.ok(Calculator.Service.methods.mulBatch);
+            test.ok(Calculator.Service.methods.divBatch);
+            test.ok(Calculator.Service.methods.eval);
             test.done();
         },
 
@@ -462,6 +516,387 @@ Suite.run({
             calculator_svc.on('end', function () { 
                 test.done();
             });
+        },
+
+        'addBatch': function (test) {
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                transport: new ProtoBuf.Rpc.Transport.Ws,
+                url: 'ws://localhost:18089'
+            });
+            calculator_svc.on('open', function () {
+                let req = {
+                    lhs: [2, -3, 2147483647], rhs: [3, 1, 1]
+                };
+                calculator_svc.addBatch(req, function (error, res) {
+                    if (!error) {
+                        test.deepEqual(res.values, [5, -2, -2147483648]);
+                    } else {
+                        test.fail(error);
+                    }
+                    calculator_svc.end();
+                });
+            });
+            calculator_svc.on('end', function () {
+                test.done();
+            });
+        },
+
+        'divBatch': function (test) {
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                transport: new ProtoBuf.Rpc.Transport.Ws,
+                url: 'ws://localhost:18089'
+            });
+            calculator_svc.on('open', function () {
+                let req = {
+                    lhs: [3, -7, 8], rhs: [2, 2, -4]
+                };
+                calculator_svc.divBatch(req, function (error, res) {
+                    if (!error) {
+                        test.deepEqual(res.values, [1, -3, -2]);
+                    } else {
+                        test.fail(error);
+                    }
+                    calculator_svc.end();
+                });
+            });
+            calculator_svc.on('end', function () {
+                test.done();
+            });
+        },
+
+        'eval': function (test) {
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                transport: new ProtoBuf.Rpc.Transport.Ws,
+                url: 'ws://localhost:18089'
+            });
+            calculator_svc.on('open', function () {
+                let Op = Api.Calculator.Expr.Op;
+                let req = { // (x0 + 2 * 3) * x1
+                    expr: {binary: {
+                        op: Op.MUL, lhs: {binary: {
+                            op: Op.ADD, lhs: {variable: 0}, rhs: {binary: {
+                                op: Op.MUL, lhs: {constant: 2}, rhs: {constant: 3}
+                            }}
+                        }}, rhs: {variable: 1}
+                    }},
+                    inputs: [0, 1, 2, 3, 4, 5], arity: 2
+                };
+                calculator_svc.eval(req, function (error, res) {
+                    if (!error) {
+                        test.deepEqual(res.values, [6, 24, 50]);
+                    } else {
+                        test.fail(error);
+                    }
+                    calculator_svc.end();
+                });
+            });
+            calculator_svc.on('end', function () {
+                test.done();
+            });
+        },
+
+        'batch-ws': function (test) {
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                transport: new ProtoBuf.Rpc.Transport.Ws,
+                url: 'ws://localhost:18089', batch: true
+            });
+            calculator_svc.on('open', function () {
+                let values = {}, expect = function (key) {
+                    return function (error, res) {
+                        if (!error) {
+                            values[key] = res.value;
+                        } else {
+                            test.fail(error);
+                        }
+                        if (Object.keys(values).length === 4) {
+                            test.deepEqual(values, {
+                                add: 5, sub: -1, mul: 6, div: 1
+                            });
+                            calculator_svc.end();
+                        }
+                    };
+                };
+                calculator_svc.add({lhs: 2, rhs: 3}, expect('add'));
+                calculator_svc.sub({lhs: 2, rhs: 3}, expect('sub'));
+                calculator_svc.mul({lhs: 2, rhs: 3}, expect('mul'));
+                calculator_svc.div({lhs: 3, rhs: 2}, expect('div'));
+            });
+            calculator_svc.on('end', function () {
+                test.done();
+            });
+        },
+
+        'batch-xhr': function (test) {
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                transport: new ProtoBuf.Rpc.Transport.Xhr,
+                url: 'http://localhost:18088', batch: true
+            });
+            calculator_svc.on('open', function () {
+                let values = {}, expect = function (key) {
+                    return function (error, res) {
+                        if (!error) {
+                            values[key] = res.value;
+                        } else {
+                            test.fail(error);
+                        }
+                        if (Object.keys(values).length === 4) {
+                            test.deepEqual(values, {
+                                add: 5, sub: -1, mul: 6, div: 1
+                            });
+                            calculator_svc.end();
+                        }
+                    };
+                };
+                calculator_svc.add({lhs: 2, rhs: 3}, expect('add'));
+                calculator_svc.sub({lhs: 2, rhs: 3}, expect('sub'));
+                calculator_svc.mul({lhs: 2, rhs: 3}, expect('mul'));
+                calculator_svc.div({lhs: 3, rhs: 2}, expect('div'));
+            });
+            calculator_svc.on('end', function () {
+                test.done();
+            });
+        },
+
+        'pipeline': function (test) {
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                url: 'ws://localhost:18089'
+            });
+            calculator_svc.on('open', function () {
+                calculator_svc.pipeline([{
+                    method: 'add', req: {lhs: 2, rhs: 3}
+                }, {
+                    method: 'mul', req: {rhs: 4}, bind: {lhs: [0, 'value']}
+                }, {
+                    method: 'div', req: {rhs: 3}, bind: {lhs: [1, 'value']}
+                }], function (error, results) {
+                    if (!error) {
+                        test.deepEqual(results.map(function (res) {
+                            return res.value;
+                        }), [5, 20, 6]);
+                    } else {
+                        test.fail(error);
+                    }
+                    calculator_svc.end();
+                });
+            });
+            calculator_svc.on('end', function () {
+                test.done();
+            });
+        },
+
+        'pipeline-zero': function (test) {
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                url: 'ws://localhost:18089'
+            });
+            calculator_svc.on('open', function () {
+                calculator_svc.pipeline([{
+                    method: 'sub', req: {lhs: 2, rhs: 2}
+                }, {
+                    method: 'mul', req: {lhs: 5, rhs: 3}, bind: {lhs: [0, 'value']}
+                }], function (error, results) {
+                    if (!error) {
+                        test.deepEqual(results.map(function (res) {
+                            return res.value;
+                        }), [0, 0]);
+                    } else {
+                        test.fail(error);
+                    }
+                    calculator_svc.end();
+                });
+            });
+            calculator_svc.on('end', function () {
+                test.done();
+            });
+        },
+
+        'timeout-status': function (test) {
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                transport: Loopback(function (rpc_req) {
+                    test.equal(rpc_req.timeout, 1000);
+                    return {id: rpc_req.id, status: 1}; // DEADLINE_EXCEEDED
+                }),
+                timeout: 1000
+            });
+            calculator_svc.on('open', function () {
+                calculator_svc.add({lhs: 2, rhs: 3}, function (error, res) {
+                    test.ok(error);
+                    test.equal(error && error.message, 'deadline exceeded');
+                    test.equal(res, null);
+                    calculator_svc.end();
+                });
+            });
+            calculator_svc.on('end', function () {
+                test.done();
+            });
+        },
+
+        'timeout-expired': function (test) {
+            if (server_3 === null) {
+                console.log('[skip] timeout-expired: no', rpc_server_cpp);
+                return test.done();
+            }
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                url: 'ws://localhost:38089', timeout: 1
+            });
+            calculator_svc.on('open', function () {
+                let pending = 2, done = function () {
+                    if (--pending === 0) {
+                        calculator_svc.end();
+                    }
+                };
+                calculator_svc.eval(SlowEval(Api, 12, 60000), function () {
+                    done(); // took the only worker, hence did not expire
+                });
+                calculator_svc.add({lhs: 2, rhs: 3}, function (error, res) {
+                    test.ok(error);
+                    test.equal(error && error.message, 'deadline exceeded');
+                    done();
+                });
+            });
+            calculator_svc.on('end', function () {
+                test.done();
+            });
+        },
+
+        'timeout': function (test) {
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                url: 'ws://localhost:18089', timeout: 1000
+            });
+            calculator_svc.on('open', function () {
+                calculator_svc.add({lhs: 2, rhs: 3}, function (error, res) {
+                    if (!error) {
+                        test.equal(res.value, 5);
+                    } else {
+                        test.fail(error);
+                    }
+                    calculator_svc.end();
+                });
+            });
+            calculator_svc.on('end', function () {
+                test.done();
+            });
+        },
+
+        'priority': function (test) {
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                transport: Loopback(function (rpc_req) {
+                    test.equal(rpc_req.priority, 1); // HIGH
+                    return {id: rpc_req.id, data: Api.Calculator.MulResult
+                        .encode({value: 6}).finish()};
+                }),
+                priority: 'high'
+            });
+            calculator_svc.on('open', function () {
+                calculator_svc.mul({lhs: 2, rhs: 3}, function (error, res) {
+                    if (!error) {
+                        test.equal(res.value, 6);
+                    } else {
+                        test.fail(error);
+                    }
+                    calculator_svc.end();
+                });
+            });
+            calculator_svc.on('end', function () {
+                test.done();
+            });
+        },
+
+        'priority-ack': function (test) {
+            if (server_3 === null) {
+                console.log('[skip] priority-ack: no', rpc_server_cpp);
+                return test.done();
+            }
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let calculator_svc = new ProtoBuf.Rpc(Api.Calculator.Service, {
+                url: 'ws://localhost:38089'
+            });
+            let reflector_svc = new ProtoBuf.Rpc(Api.Reflector.Service, {
+                url: 'ws://localhost:38089'
+            });
+
+            //
+            // Once the first (low priority) eval returned, the others queue
+            // for the only worker: The (high priority) ack has to overtake
+            // them, while in FIFO order it would complete last.
+            //
+
+            let order = [], opened = 0, evals = 6;
+            let done = function (name) {
+                order.push(name);
+                if (order.length === evals + 1) {
+                    test.ok(order.indexOf('ack') < evals, order.join(' '));
+                    calculator_svc.end();
+                    reflector_svc.end();
+                }
+            };
+            let start = function () {
+                if (++opened < 2) {
+                    return;
+                }
+                for (let i = 0; i < evals; i++) {
+                    calculator_svc.eval(SlowEval(Api, 12, 60000), function (error) {
+                        test.ok(!error, error);
+                        if (order.length === 0) {
+                            reflector_svc.ack({
+                                timestamp: new Date().toISOString()
+                            }, function (error) {
+                                test.ok(!error, error);
+                                done('ack');
+                            });
+                        }
+                        done('eval');
+                    });
+                }
+            };
+            calculator_svc.on('open', start);
+            reflector_svc.on('open', start);
+
+            let ended = 0;
+            calculator_svc.on('end', function () {
+                if (++ended === 2) {
+                    test.done();
+                }
+            });
+            reflector_svc.on('end', function () {
+                if (++ended === 2) {
+                    test.done();
+                }
+            });
         }
     },
 
@@ -511,6 +946,30 @@ Suite.run({
             setTimeout(function () {
                 listener_svc.end();
             }, 100);
+        },
+
+        'cancel': function (test) {
+            let ApiFactory = ProtoBuf.loadSync('example/protocol/api.proto'),
+                Api = ApiFactory.resolve();
+
+            let listener_svc = new ProtoBuf.Rpc(Api.Listener.Service, {
+                url: 'ws://localhost:18089'
+            });
+            listener_svc.on('open', function () {
+                let req = {
+                    timestamp: new Date().toISOString()
+                };
+                listener_svc.sub(req, function (error, res) {
+                    if (error) {
+                        test.equal(error.message, 'cancelled');
+                        listener_svc.end();
+                    }
+                });
+                listener_svc.cancel();
+            });
+            listener_svc.on('end', function () {
+                test.done();
+            });
         }
     },
 });